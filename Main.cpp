@@ -5,21 +5,101 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include <learnopenggl/camera.h>
+#include <learnopenggl/shader_m.h>
+
+#include "asset_pack.h"
+#include "benchmark.h"
+#include "clustered_lights.h"
+#include "dynamic_resolution.h"
+#include "frame_arena.h"
+#include "frame_pacing.h"
+#include "gl_state_cache.h"
+#include "gpu_culling.h"
+#include "gpu_memory.h"
+#include "headless.h"
+#include "input_recording.h"
+#include "instance_batch.h"
+#include "job_system.h"
+#include "loose_octree.h"
+#include "mesh.h"
+#include "occlusion_culler.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "scene_graph.h"
+#include "shader_variants.h"
+#include "shadow_atlas.h"
+#include "stress_scene.h"
+#include "texture_array.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
+
+// after the project headers, which include stb_image.h for its declarations only
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#include <learnopenggl/camera.h>
-#include <learnopenggl/shader_m.h>
+#ifdef COUNT_ALLOCATIONS
+// every operator new of the process is counted (heapAllocations() in frame_arena.h), so the report
+// shows whether the frame loop still allocates. They stay out of line: inlined, GCC sees malloc()
+// paired with operator delete, or operator new with free(), and warns (-Wmismatched-new-delete)
+#if defined(__GNUC__)
+#define NOT_INLINED __attribute__((noinline))
+#else
+#define NOT_INLINED
+#endif
+
+NOT_INLINED void* operator new(size_t size)
+{
+    heapAllocations()++;
+    if (void* memory = malloc(size > 0 ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+NOT_INLINED void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+NOT_INLINED void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+NOT_INLINED void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+NOT_INLINED void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+
+NOT_INLINED void operator delete[](void* memory, size_t) noexcept
+{
+    free(memory);
+}
+#endif
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+void applyInput(const InputRecord& input);
 
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
@@ -29,445 +109,1044 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// the size of the window's framebuffer, kept up to date by framebuffer_size_callback
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
+
+// input gathered since the last frame was launched; the callbacks only record, the camera moves in applyInput
+InputRecord frameInput = {};
 
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
-struct Vertex
+// command line options
+// --headless renders offscreen with a fixed timestep and reports frame timings as JSON
+struct Options
 {
-    GLfloat x, y, z;	// Position
-    GLubyte r, g, b;	// Color
-    GLfloat u, v;		// UV coordinates
-    GLfloat nx, ny, nz;
+    bool headless = false;
+    int frames = 0;                 // 0 = run until the window is closed
+    int warmup = 5;                 // frames rendered before measuring starts
+    float timestep = 1.0f / 60.0f;  // simulated seconds per frame in headless mode
+    int width = SCR_WIDTH;
+    int height = SCR_HEIGHT;
+    const char* output = nullptr;   // benchmark JSON file, stdout if not set
+    const char* shaderCache = "shader_cache";   // program binary cache directory, nullptr to always compile
+    bool occlusionCulling = true;
+    int lights = 0;                 // point lights (torches) on top of the orbiting light
+    const char* shadows = "off";    // off, naive (every shadow map face every frame) or cached
+    int shadowBudget = 2;           // cube faces of a moving light re-rendered per frame when cached
+    int threads = 0;                // job system threads including the GL thread, 0 = one per hardware thread
+    const char* profile = nullptr;  // Chrome trace of startup and the first profileFrames frames (PROFILING builds)
+    int profileFrames = 60;
+    const char* record = nullptr;   // writes the input and time of every frame to this file
+    const char* replay = nullptr;   // renders the frames of a recording instead of taking input
+    const char* frameLog = nullptr; // per-frame timings of the measured frames as CSV
+    int stressObjects = 0;          // generated tables and spinning cubes on top of the hand-written scene
+    int stressGrid = 1;             // spread over stressGrid x stressGrid chambers, torches too
+    const char* pack = nullptr;     // asset pack (tools/packc) to map; whatever it lacks is loaded from the loose files
+    double dynamicResolution = 0.0; // target frame time in ms the render resolution is scaled for, 0 = always full size
+    float minScale = 0.5f;          // the smallest render scale dynamic resolution goes down to
+    bool gpuCulling = false;        // cull on the GPU and submit the main pass with multi-draw indirect (GL 4.3)
+    int frameArenaMb = 8;           // per job system thread and frame, for the lists a frame builds
+    const char* pacing = nullptr;   // vsync, adaptive, uncapped or limit; vsync with a window, uncapped headless
+    double fpsLimit = 0.0;          // frames per second of the limit mode
+    int framesInFlight = 2;         // frames submitted to the GPU that may be unfinished when the next one starts
+    bool lateInput = false;         // build each frame right after sampling its input instead of during the previous frame
 };
 
-char textureList[4][15] = { "stone.jpg" , "dailee.jpg", "sun.jpg", "stonebrick.jpg"};
+bool parseOptions(int argc, char** argv, Options& options);
+ShaderSources loadShaderSources(const AssetPack& pack, const char* vertexPath, const char* fragmentPath);
+ShaderSources loadComputeSource(const AssetPack& pack, const char* computePath);
 
-int main()
+// per-frame camera, light and light cluster data, mirrors the std140 FrameData block in the shaders
+struct FrameUniforms
 {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 viewPos;
+    glm::vec4 lightPos;
+    glm::vec4 lightColor;
+    glm::vec4 clusterTiles;
+    glm::vec4 clusterSlices;
+};
 
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Torture Chamber", NULL, NULL);
-    if (window == NULL)
+// everything the GL thread needs to draw one frame, filled by the frame's jobs; there are two, so the
+// jobs can build the next frame while the GL thread submits this one. The lists live in the frame's
+// arena, which is reset when the frame is built again, after the GL thread submitted it: every upload
+// copies the lists at the call, so no GL fence has to pass first
+struct FrameCommands
+{
+    FrameArena arena;
+    FrameUniforms uniforms;
+    glm::vec3 lightPos;
+    InputRecord input;                          // what the camera moved by before the frame was built
+    FrameStats::Clock::time_point inputTime;    // when the frame took its input
+    ClusterLists clusters;
+    InstanceUpload lit;
+    InstanceUpload emissive;
+    InstanceUpload dynamicCasters;
+    FrameVector<CasterBounds> dynamicCasterBounds;
+    GpuObjectUpload objects;            // the GPU-driven path's instead of lit and emissive
+    RenderQueue queue;                  // the main pass
+    int outputWidth = 0, outputHeight = 0;  // the window's (or headless target's) size
+    int renderWidth = 0, renderHeight = 0;  // the main pass's, smaller with dynamic resolution
+    float scale = 1.0f;
+    unsigned int visible = 0, culled = 0, occluded = 0;
+    double occlusionMs = 0.0;
+    double binningMs = 0.0;
+
+    // starts building the frame again: the lists start out empty in the arena
+    void reset()
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        arena.reset();
+        resetFrameVector(clusters.packed, arena);
+        resetFrameVector(clusters.grid, arena);
+        resetFrameVector(clusters.indices, arena);
+        resetFrameVector(lit.instances, arena);
+        resetFrameVector(emissive.instances, arena);
+        resetFrameVector(dynamicCasters.instances, arena);
+        resetFrameVector(dynamicCasterBounds, arena);
+        resetFrameVector(objects.objects, arena);
+        queue.reset(arena);
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+};
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
-    }
+const unsigned int FRAME_UNIFORMS_BINDING = 0;
+const unsigned int LIGHT_CLUSTER_TEXTURE_UNIT = 1;     // lightData, lightGrid and lightIndices take units 1-3
+const unsigned int SHADOW_UNIFORMS_BINDING = 1;
+const unsigned int SHADOW_ATLAS_TEXTURE_UNIT = 4;
 
-    glEnable(GL_DEPTH_TEST);
+char textureList[4][15] = { "stone.jpg" , "dailee.jpg", "sun.jpg", "stonebrick.jpg"};
 
-    Shader lightingShader("main.vsh", "main.fsh");
-    Shader lightCubeShader("light.vsh", "light.fsh");
+int main(int argc, char** argv)
+{
+    // startup is measured from here to the first finished frame
+    FrameStats::Clock::time_point processStart = FrameStats::Clock::now();
 
-    //Vertex
-    // ------------------------------------------------------------------
-    Vertex vertices[36];
-
-	// Position									Color				UV					Normals
-	//Front
-	vertices[0] = { -0.5f, -0.5f, -0.5f,	0  , 0  , 255,		0.0f, 0.0f,	     0.0f, 0.0f, -1.0f };	// Lower-left
-	vertices[1] = {	 0.5f, -0.5f, -0.5f,	0  , 0  , 255,		1.0f, 0.0f,		 0.0f, 0.0f, -1.0f };	// Lower-right
-	vertices[2] = {  0.5f, 0.5f, -0.5f,		0  , 0  , 255,		1.0f, 1.0f,		 0.0f, 0.0f, -1.0f };	// Upper-right
-
-	vertices[3] = {  0.5f, 0.5f, -0.5f,		0  , 0  , 255,		1.0f, 1.0f,		 0.0f, 0.0f, -1.0f };	// Upper-right
-	vertices[4] = { -0.5f, 0.5f, -0.5f,		0  , 0  , 255,		0.0f, 1.0f,		 0.0f, 0.0f, -1.0f };	// Upper-left
-	vertices[5] = { -0.5f, -0.5f, -0.5f,	0  , 0  , 255,		0.0f, 0.0f,		 0.0f, 0.0f, -1.0f };	// Lower-left
-
-
-	//Back
-	vertices[6] = { -0.5f, -0.5f, 0.5,		0  , 0  , 255,		0.0f, 0.0f, 	 0.0f, 0.0f, 1.0f };	// Lower-left
-	vertices[7] = { 0.5f, -0.5f, 0.5f,		0  , 0  , 255,		1.0f, 0.0f,		 0.0f, 0.0f, 1.0f };	// Lower-right
-	vertices[8] = { 0.5f, 0.5f, 0.5f,		0  , 0  , 255,		1.0f, 1.0f,		 0.0f, 0.0f, 1.0f };	// Upper-right
-
-	vertices[9] = {   0.5f, 0.5f, 0.5f,		0  , 0  , 255,		1.0f, 1.0f,		 0.0f, 0.0f, 1.0f };	// Upper-right
-	vertices[10] = { -0.5f, 0.5f, 0.5f,		0  , 0  , 255,		0.0f, 1.0f,		 0.0f, 0.0f, 1.0f };	// Upper-left
-	vertices[11] = { -0.5f, -0.5f, 0.5f,	0  , 0  , 255,		0.0f, 0.0f,		 0.0f, 0.0f, 1.0f };	// Lower-left
-
-	//Side left
-	vertices[12] = { -0.5f, -0.5f, -0.5f,	0  , 0  , 255,		0.0f, 0.0f,		-1.0f, 0.0f, 0.0f };	// Lower-left
-	vertices[13] = { -0.5f, -0.5f, 0.5f,	0  , 0  , 255,		1.0f, 0.0f,		-1.0f, 0.0f, 0.0f };	// Lower-right
-	vertices[14] = { -0.5f, 0.5f, 0.5f,		0  , 0  , 255,		1.0f, 1.0f,		-1.0f, 0.0f, 0.0f };	// Upper-right
-
-	vertices[15] = { -0.5f, 0.5f, 0.5f,		0  , 0  , 255,		1.0f, 1.0f,		-1.0f, 0.0f, 0.0f };	// Upper-right
-	vertices[16] = { -0.5f, 0.5f, -0.5f,	0  , 0  , 255,		0.0f, 1.0f,		-1.0f, 0.0f, 0.0f };	// Upper-left
-	vertices[17] = { -0.5f, -0.5f, -0.5f,	0  , 0  , 255,		0.0f, 0.0f,		-1.0f, 0.0f, 0.0f };	// Lower-left
-
-	//Side Right
-	vertices[18] = { 0.5f, -0.5f, -0.5f,	0  , 0  , 255,		0.0f, 0.0f,		 1.0f, 0.0f, 0.0f };	// Lower-left
-	vertices[19] = { 0.5f, -0.5f, 0.5f,		0  , 0  , 255,		1.0f, 0.0f,		 1.0f, 0.0f, 0.0f };	// Lower-right
-	vertices[20] = { 0.5f, 0.5f, 0.5f,		0  , 0  , 255,		1.0f, 1.0f,		 1.0f, 0.0f, 0.0f };	// Upper-right
-
-	vertices[21] = { 0.5f, 0.5f, 0.5f,		0  , 0  , 255,		1.0f, 1.0f,		 1.0f, 0.0f, 0.0f };	// Upper-right
-	vertices[22] = { 0.5f, 0.5f, -0.5f,		0  , 0  , 255,		0.0f, 1.0f,		 1.0f, 0.0f, 0.0f };	// Upper-left
-	vertices[23] = { 0.5f, -0.5f, -0.5f,	0  , 0  , 255,		0.0f, 0.0f,		 1.0f, 0.0f, 0.0f };	// Lower-left
-
-	//Top
-	vertices[24] = { -0.5f, 0.5f, 0.5f,		0  , 0  , 255,		0.0f, 0.0f,		 0.0f, 1.0f, 0.0f };	// Lower-left
-	vertices[25] = { 0.5f, 0.5f, 0.5f,		0  , 0  , 255,		1.0f, 0.0f,		 0.0f, 1.0f, 0.0f };	// Lower-right
-	vertices[26] = { 0.5f, 0.5f, -0.5f,		0  , 0  , 255,		1.0f, 1.0f,		 0.0f, 1.0f, 0.0f };	// Upper-right
-
-	vertices[27] = { 0.5f, 0.5f, -0.5f,		0  , 0  , 255,		1.0f, 1.0f,		 0.0f, 1.0f, 0.0f };	// Upper-right
-	vertices[28] = { -0.5f, 0.5f, -0.5f,	0  , 0  , 255,		0.0f, 1.0f,		 0.0f, 1.0f, 0.0f };	// Upper-left
-	vertices[29] = { -0.5f, 0.5f, 0.5f,		0  , 0  , 255,		0.0f, 0.0f,		 0.0f, 1.0f, 0.0f };	// Lower-left
-     
-	//Bottom
-	vertices[30] = { -0.5f, -0.5f, 0.5f,	0  , 0  , 255,		0.0f, 0.0f,		 0.0f, -1.0f, 0.0f };	// Lower-left
-	vertices[31] = { 0.5f, -0.5f, 0.5f,		0  , 0  , 255,		1.0f, 0.0f,		 0.0f, -1.0f, 0.0f };	// Lower-right
-	vertices[32] = { 0.5f, -0.5f, -0.5f,	0  , 0  , 255,  	1.0f, 1.0f,		 0.0f, -1.0f, 0.0f };	// Upper-right
-
-	vertices[33] = { 0.5f, -0.5f, -0.5f,	0  , 0  , 255,		1.0f, 1.0f,		 0.0f, -1.0f, 0.0f };	// Upper-right
-	vertices[34] = { -0.5f, -0.5f, -0.5f,	0  , 0  , 255,		0.0f, 1.0f,		 0.0f, -1.0f, 0.0f };	// Upper-left
-	vertices[35] = { -0.5f, -0.5f, 0.5f,	0  , 0  , 255,		0.0f, 0.0f,		 0.0f, -1.0f, 0.0f };	// Lower-left
-
-    // first, configure the cube's VAO (and VBO)
-    unsigned int VBO, cubeVAO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &VBO);
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return -1;
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    // a replay renders exactly the recorded frames, at the size they were recorded at
+    InputRecording recording;
+    if (options.replay != nullptr)
+    {
+        if (!recording.load(options.replay))
+            return -1;
+        options.frames = (int)recording.Frames.size() - options.warmup;
+        if (options.frames <= 0)
+        {
+            std::cout << "ERROR::INPUT_RECORDING::TOO_SHORT: " << recording.Frames.size() << " frames, "
+                      << options.warmup << " of them warmup" << std::endl;
+            return -1;
+        }
+        options.width = recording.Width;
+        options.height = recording.Height;
+    }
+    else
+    {
+        recording.Width = options.width;
+        recording.Height = options.height;
+    }
 
-    glBindVertexArray(cubeVAO);
+    glfwInit();
 
-    // Vertex attribute 0 - Position
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, x));
+    GLFWwindow* window = NULL;
+    HeadlessContext headlessContext;
+    OffscreenTarget offscreen;
 
-    // Vertex attribute 1 - Color
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)(offsetof(Vertex, r)));
+    // the GPU-driven path needs GL 4.3; without it the run falls back to CPU submission
+    int contextMajor = options.gpuCulling ? 4 : 3;
+    if (options.headless)
+    {
+        if (!headlessContext.create(contextMajor, 3) && (contextMajor == 3 || !headlessContext.create(3, 3)))
+        {
+            std::cout << "Failed to create headless OpenGL context" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+        if (!offscreen.create(options.width, options.height))
+            return -1;
+        framebufferWidth = options.width;
+        framebufferHeight = options.height;
+    }
+    else
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, contextMajor);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    // Vertex attribute 2 - UV coordinate
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, u)));
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
 
-    // Vertex attribute 3 - Normal vectors
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, nx)));
+        window = glfwCreateWindow(options.width, options.height, "Torture Chamber", NULL, NULL);
+        if (window == NULL && contextMajor > 3)
+        {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+            window = glfwCreateWindow(options.width, options.height, "Torture Chamber", NULL, NULL);
+        }
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
 
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    // second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
-    unsigned int lightCubeVAO;
-    glGenVertexArrays(1, &lightCubeVAO);
-    glBindVertexArray(lightCubeVAO);
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    // note that we update the lamp's position attribute's stride to reflect the updated buffer data
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, x));
-    glEnableVertexAttribArray(0);
+    glEnable(GL_DEPTH_TEST);
 
-    GLuint tex;
-    glGenTextures(3, &tex);
+    if (options.gpuCulling && !GpuCuller::supported())
+    {
+        std::cout << "ERROR::GPU_CULLING::NOT_SUPPORTED: needs GL 4.3 and GL_ARB_shader_draw_parameters, using CPU submission" << std::endl;
+        options.gpuCulling = false;
+    }
 
-    // --- Load our image using stb_image ---
+    // the profiler records from here, so the trace includes texture loading and shader building
+#ifdef PROFILING
+    if (options.profile != nullptr)
+        Profiler::get().start();
+#endif
+    PROFILE_THREAD("GL thread");
+
+    // worker threads for texture decoding
+    ThreadPool loaderPool;
+    loaderPool.start();
+
+    // and the job system that runs the CPU side of every frame
+    JobSystem jobs;
+    jobs.start(options.threads);
+
+    // the asset pack is mapped, not read: meshes, textures and shaders are used straight from the mapping
+    AssetPack pack;
+    if (options.pack != nullptr && !pack.open(options.pack))
+        std::cout << "ERROR::ASSET_PACK::NOT_LOADED: " << options.pack << ", using the loose files" << std::endl;
+
+    // --- Load our textures ---
+    // images are decoded on worker threads and streamed in over the first frames, meanwhile the rest of
+    // the setup runs and the scene renders with a grey placeholder; layer i is textureList[i]
+    std::vector<std::string> texturePaths(textureList, textureList + sizeof textureList / sizeof textureList[0]);
+    TextureArray textures;
+    TextureStreamer textureStreamer;
+    textureStreamer.start(textures, texturePaths, loaderPool, &pack);
+    textures.bind(0);
+
+    // programs linked on an earlier run are loaded as driver binaries instead of being compiled again
+    FrameStats::Clock::time_point shaderStart = FrameStats::Clock::now();
+    ProgramCache programCache;
+    programCache.create(options.shaderCache != nullptr ? options.shaderCache : "");
+    // the shadow-casting lights: the orbiting light (light 0) moves every frame, the two lanterns at
+    // the back never do. They only exist with shadows on, so the default scene stays the benchmark's
+    bool shadowsEnabled = strcmp(options.shadows, "off") != 0;
+    struct ShadowLightSetup { glm::vec3 position; float radius; glm::vec3 color; bool stationary; };
+    const ShadowLightSetup shadowLightSetup[] = {
+        { lightPos, 20.0f, glm::vec3(0.0f), false },
+        { glm::vec3(-3.0f, 3.5f, -2.5f), 8.0f, glm::vec3(0.6f, 0.4f, 0.2f), true },
+        { glm::vec3(3.0f, 3.5f, -2.5f), 8.0f, glm::vec3(0.6f, 0.4f, 0.2f), true },
+    };
+    const int shadowLightCount = sizeof shadowLightSetup / sizeof shadowLightSetup[0];
+
+    // every material is a variant of main.vsh/main.fsh with the features it needs; the clustered point
+    // light loop and the shadow lookups are only compiled into the lit one when the scene uses them.
+    // The GPU-driven path fetches the per-object data by draw index instead of from instance attributes
+    const uint32_t materialFeatures[] = {
+        0,                                  // MATERIAL_NONE
+        SHADER_TEXTURED | SHADER_SPECULAR,  // MATERIAL_LIT
+        SHADER_TEXTURED | SHADER_EMISSIVE,  // MATERIAL_EMISSIVE
+    };
+    uint32_t sceneFeatures = (options.lights > 0 ? SHADER_CLUSTERED_LIGHTS : 0) | (shadowsEnabled ? SHADER_SHADOWS : 0);
+    ShaderVariantKey materialVariants[3] = {};
+    for (int material = MATERIAL_LIT; material <= MATERIAL_EMISSIVE; material++)
+    {
+        // unlit materials need none of the scene's lights
+        if (materialFeatures[material] & SHADER_EMISSIVE)
+            materialVariants[material] = makeShaderVariant(materialFeatures[material]);
+        else
+            materialVariants[material] = makeShaderVariant(materialFeatures[material] | sceneFeatures, shadowsEnabled ? shadowLightCount : 0);
+    }
+    ShaderVariants materialShaders;
+    materialShaders.create(loadShaderSources(pack, options.gpuCulling ? "indirect.vsh" : "main.vsh", "main.fsh"), &programCache,
+                           "#define SHADOW_MAX_LIGHTS " + std::to_string((int)ShadowUniforms::MAX_LIGHTS) +
+                           "\n#define SHADOW_NEAR_PLANE " + std::to_string(SHADOW_NEAR_PLANE) + "\n");
+    materialShaders.precompile(std::vector<ShaderVariantKey>(materialVariants + MATERIAL_LIT, materialVariants + MATERIAL_EMISSIVE + 1));
+    Shader& lightingShader = materialShaders.get(materialVariants[MATERIAL_LIT]);
+    Shader& lightCubeShader = materialShaders.get(materialVariants[MATERIAL_EMISSIVE]);
+    Shader shadowShader(loadShaderSources(pack, "shadow.vsh", "shadow.fsh"), &programCache);
+    std::unique_ptr<Shader> cullShader;
+    if (options.gpuCulling)
+        cullShader.reset(new Shader(loadComputeSource(pack, "cull.csh"), &programCache));
+    double shaderSetupMs = FrameStats::milliseconds(shaderStart, FrameStats::Clock::now());
+
+    // GPU memory: meshes and instance data are ranges of a few large buffers, per-frame data (the frame
+    // uniforms, instance updates on their way into the heap) goes through a fenced ring
+    GpuHeap gpuMemory;
+    gpuMemory.create(16 * 1024 * 1024);
+    GpuRingBuffer frameRing;
+    frameRing.create(1024 * 1024);
+    GLint uniformAlignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+
+    // Mesh
+    // ------------------------------------------------------------------
+    // the unit cube every object is made of, compiled from cube.obj by tools/meshc (indexed, quantized vertices)
+    Mesh cubeMesh;
+    const AssetPackEntry* cubeEntry = pack.find("cube.mesh");
+    if (cubeEntry != NULL ? !cubeMesh.loadFromMemory(pack.data(*cubeEntry), (size_t)cubeEntry->size, "cube.mesh", gpuMemory) : !cubeMesh.load("cube.mesh", gpuMemory))
+        return -1;
 
-    // Im image-space (pixels), (0, 0) is the upper-left corner of the image
-    // However, in u-v coordinates, (0, 0) is the lower-left corner of the image
-    // This means that the image will appear upside-down when we use the image data as is
-    // This function tells stbi to flip the image vertically so that it is not upside-down when we use it
-    stbi_set_flip_vertically_on_load(true);
+    // first, configure the cube's VAO (vertex and index buffer come from the mesh)
+    unsigned int cubeVAO;
+    glGenVertexArrays(1, &cubeVAO);
+    cubeMesh.attach(cubeVAO);
 
-    // 'imageWidth' and imageHeight will contain the width and height of the loaded image respectively
-    int imageWidth, imageHeight, numChannels;
-    int textureCount = sizeof textureList / sizeof textureList[0];
+    // second, configure the light's VAO (the buffers stay the same; the light object is also a 3D cube)
+    unsigned int lightCubeVAO;
+    glGenVertexArrays(1, &lightCubeVAO);
+    cubeMesh.attach(lightCubeVAO);
+
+
+    // scene
+    // -----
+    SceneGraph scene;
+
+    // the large boxes that hide the rest of the scene, for occlusion culling
+    std::vector<int> occluders;
+
+    //Table
+    int table = scene.addGroup(SceneGraph::NO_PARENT);
+    occluders.push_back(scene.addNode(table, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(4.0f, 0.1f, 4.0f), 0));
+    scene.addNode(table, glm::vec3(1.8f, -1.5f, 1.8f), glm::vec3(0.2f, -3.0f, 0.2f), 0);
+    scene.addNode(table, glm::vec3(-1.8f, -1.5f, 1.8f), glm::vec3(0.2f, -3.0f, 0.2f), 0);
+    scene.addNode(table, glm::vec3(1.8f, -1.5f, -1.8f), glm::vec3(0.2f, -3.0f, 0.2f), 0);
+    scene.addNode(table, glm::vec3(-1.8f, -1.5f, -1.8f), glm::vec3(0.2f, -3.0f, 0.2f), 0);
+
+    //Walls and Floors
+    int chamber = scene.addGroup(SceneGraph::NO_PARENT);
+    occluders.push_back(scene.addNode(chamber, glm::vec3(0.0f, 1.0f, -4.0f), glm::vec3(8.0f, 8.0f, 0.1f), 3));
+    occluders.push_back(scene.addNode(chamber, glm::vec3(-4.0f, 1.0f, 1.0f), glm::vec3(0.1f, 8.0f, 10.0f), 3));
+    occluders.push_back(scene.addNode(chamber, glm::vec3(4.0f, 1.0f, 1.0f), glm::vec3(0.1f, 8.0f, 10.0f), 3));
+    occluders.push_back(scene.addNode(chamber, glm::vec3(0.0f, -3.0f, 1.0f), glm::vec3(8.0f, 0.1f, 10.0f), 3));
+    occluders.push_back(scene.addNode(chamber, glm::vec3(0.0f, 5.0f, 1.0f), glm::vec3(8.0f, 0.1f, 10.0f), 3));
+    occluders.push_back(scene.addNode(chamber, glm::vec3(0.0f, 1.0f, 6.0f), glm::vec3(8.0f, 8.0f, 0.1f), 3));
+
+    //Banner
+    occluders.push_back(scene.addNode(chamber, glm::vec3(0.0f, 2.0f, -3.5f), glm::vec3(4.0f, 4.0f, 0.1f), 1));
+
+    //Rotating Cubes, two per pivot
+    glm::vec3 pivots[] = { glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(2.0f, 2.0f, 1.0f), glm::vec3(-2.0f, 2.0f, 1.0f) };
+    int rotatingCubes[6];
+    for (int i = 0; i < 3; i++)
+    {
+        int pivot = scene.addGroup(SceneGraph::NO_PARENT, pivots[i]);
+        rotatingCubes[2 * i] = scene.addNode(pivot, glm::vec3(0.0f), glm::vec3(0.1f, 0.1f, 0.1f), 0);
+        rotatingCubes[2 * i + 1] = scene.addNode(pivot, glm::vec3(0.0f), glm::vec3(0.1f, 0.1f, 0.1f), 0);
+    }
 
-    for (int i = 0; i < textureCount; i++) {
-        // Read the image data and store it in an unsigned char array
-        unsigned char* imageData = stbi_load(textureList[i], &imageWidth, &imageHeight, &numChannels, 0);
+    // the lamp object, a smaller cube
+    int lightCube = scene.addNode(SceneGraph::NO_PARENT, lightPos, glm::vec3(0.2f), 2, MATERIAL_EMISSIVE);
+
+    // generated content for scaling runs, none by default
+    StressScene stress;
+    stress.generate(scene, options.stressObjects, options.stressGrid);
+    occluders.insert(occluders.end(), stress.Walls.begin(), stress.Walls.end());
+
+    // every drawn node is bounded by the cube mesh; the bounds live in a loose octree for frustum culling
+    scene.setMeshBounds(0, cubeMesh.BoundsMin, cubeMesh.BoundsMax);
+    scene.update();
+    LooseOctree octree;
+    octree.build(scene);
+    std::vector<int> visibleNodes;
+    std::vector<unsigned char> nodeVisible(scene.size(), 0);
+
+    // what survives the frustum is tested against a small software depth buffer of the occluders
+    OcclusionCuller occlusionCuller;
+    occlusionCuller.create(256, framebufferWidth, framebufferHeight, &jobs);
+    occlusionCuller.setOccluders(occluders, cubeMesh.BoundsMin, cubeMesh.BoundsMax);
+
+    // lit objects and the lamp each go into one instance buffer, attached to their VAO
+    InstanceBatch litBatch;
+    litBatch.build(scene, MATERIAL_LIT, gpuMemory);
+    litBatch.attach(cubeVAO);
+    InstanceBatch emissiveBatch;
+    emissiveBatch.build(scene, MATERIAL_EMISSIVE, gpuMemory);
+    emissiveBatch.attach(lightCubeVAO);
+
+    // the GPU-driven path keeps the same objects in its own buffer, lit ones first, and draws each
+    // group with the VAO and program of its batch
+    GpuCuller gpuCuller;
+    if (options.gpuCulling)
+    {
+        std::vector<std::vector<int> > groups;
+        groups.push_back(litBatch.Nodes);
+        groups.push_back(emissiveBatch.Nodes);
+        gpuCuller.build(scene, groups, cubeMesh, gpuMemory);
+        lightingShader.use();
+        lightingShader.setInt("firstObject", gpuCuller.groupStart(0));
+        lightCubeShader.use();
+        lightCubeShader.setInt("firstObject", gpuCuller.groupStart(1));
+    }
 
-        // Make sure that we actually loaded the image before uploading the data to the GPU
-        if (imageData != nullptr)
+    // shadows: the rotating cubes are the only casters that move, every other lit object is static;
+    // each set gets its own instance buffer and VAO for the depth-only passes
+    std::vector<int> dynamicCasterNodes(rotatingCubes, rotatingCubes + 6);
+    dynamicCasterNodes.insert(dynamicCasterNodes.end(), stress.Spinners.begin(), stress.Spinners.end());
+    std::vector<int> staticCasterNodes;
+    for (int node : litBatch.Nodes)
+        if (std::find(dynamicCasterNodes.begin(), dynamicCasterNodes.end(), node) == dynamicCasterNodes.end())
+            staticCasterNodes.push_back(node);
+    std::vector<unsigned char> allNodes(scene.size(), 1);
+    unsigned int casterVAOs[2];
+    glGenVertexArrays(2, casterVAOs);
+    InstanceBatch staticCasters;
+    staticCasters.build(scene, staticCasterNodes, gpuMemory);
+    cubeMesh.attach(casterVAOs[0]);
+    staticCasters.attach(casterVAOs[0]);
+    InstanceBatch dynamicCasters;
+    dynamicCasters.build(scene, dynamicCasterNodes, gpuMemory);
+    cubeMesh.attach(casterVAOs[1]);
+    dynamicCasters.attach(casterVAOs[1]);
+
+    ShadowAtlas shadowAtlas;
+    if (shadowsEnabled)
+    {
+        shadowAtlas.create(256, SHADOW_UNIFORMS_BINDING);
+        shadowAtlas.CacheMode = strcmp(options.shadows, "naive") == 0 ? ShadowAtlas::NAIVE : ShadowAtlas::CACHED;
+        shadowAtlas.FaceBudget = options.shadowBudget;
+        for (const ShadowLightSetup& light : shadowLightSetup)
+            shadowAtlas.addLight(light.position, light.radius, light.color, light.stationary);
+        shadowAtlas.bind(SHADOW_ATLAS_TEXTURE_UNIT);
+    }
+    GLint shadowViewProjection = shadowShader.getUniformLocation("lightViewProjection");
+    // redundant program, vertex array, texture and uniform changes of the frame loop are dropped here
+    GLStateCache stateCache;
+    std::function<void()> drawStaticCasters = [&]() {
+        stateCache.bindVertexArray(casterVAOs[0]);
+        cubeMesh.draw(staticCasters.count());
+    };
+    std::function<void()> drawDynamicCasters = [&]() {
+        stateCache.bindVertexArray(casterVAOs[1]);
+        cubeMesh.draw(dynamicCasters.count());
+    };
+    // the GPU-driven main pass: one multi-draw per program, culled by cull.csh beforehand
+    std::function<unsigned int()> drawIndirect = [&]() {
+        unsigned int draws = 0;
         {
-            glActiveTexture(GL_TEXTURE0 + i);
-            // Our texture is 2D, so we bind our texture to the GL_TEXTURE_2D target
-            glBindTexture(GL_TEXTURE_2D, tex + i);
-
-            // Set the filtering methods for magnification and minification
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-            // Set the wrapping method for the s-axis (x-axis) and t-axis (y-axis)
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-            // Upload the image data to GPU memory
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth, imageHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
-
-            // If we set minification to use mipmaps, we can tell OpenGL to generate the mipmaps for us
-            //glGenerateMipmap(GL_TEXTURE_2D);
+            PROFILE_ZONE("draw lit");
+            PROFILE_GPU_ZONE("draw lit");
+            stateCache.useProgram(lightingShader.ID);
+            stateCache.bindTexture(0, GL_TEXTURE_2D_ARRAY, textures.ID);
+            stateCache.bindVertexArray(cubeVAO);
+            draws += gpuCuller.draw(0);
+        }
+        {
+            PROFILE_ZONE("draw emissive");
+            PROFILE_GPU_ZONE("draw emissive");
+            stateCache.useProgram(lightCubeShader.ID);
+            stateCache.bindVertexArray(lightCubeVAO);
+            draws += gpuCuller.draw(1);
+        }
+        return draws;
+    };
+
+    // torches: small point lights spread through the chamber, each drifting around its own spot;
+    // the fixed seed keeps every run identical
+    std::vector<glm::vec3> torchBase(options.lights);
+    std::vector<glm::vec3> torchDrift(options.lights);
+    std::vector<PointLight> pointLights(options.lights);
+    srand(1);
+    for (int i = 0; i < options.lights; i++)
+    {
+        float r[8];
+        for (float& value : r)
+            value = (float)rand() / RAND_MAX;
+        torchBase[i] = glm::vec3(-3.8f + 7.6f * r[0], -2.8f + 7.6f * r[1], -3.8f + 9.6f * r[2]) +
+                       StressScene::chamberOrigin(i % stress.Chambers, options.stressGrid);
+        torchDrift[i] = glm::vec3(0.5f + r[3], 6.2831853f * r[4], 0.2f + 0.3f * r[5]);   // speed, phase, amplitude
+        pointLights[i].Radius = 0.5f + 0.5f * r[6];
+        pointLights[i].Color = glm::mix(glm::vec3(1.0f, 0.45f, 0.1f), glm::vec3(1.0f, 0.8f, 0.45f), r[7]) * 0.6f;
+    }
+    ClusteredLights clusteredLights;
+    clusteredLights.create();
+    glm::mat4 clusterProjection(0.0f);  // the projection the cluster bounds were computed for
+
+    // both programs sample the texture array bound to unit 0 and read camera and light from one uniform buffer
+    lightingShader.use();
+    lightingShader.setInt("tex", 0);
+    lightingShader.setInt("lightData", LIGHT_CLUSTER_TEXTURE_UNIT);
+    lightingShader.setInt("lightGrid", LIGHT_CLUSTER_TEXTURE_UNIT + 1);
+    lightingShader.setInt("lightIndices", LIGHT_CLUSTER_TEXTURE_UNIT + 2);
+    lightingShader.setInt("shadowAtlas", SHADOW_ATLAS_TEXTURE_UNIT);
+    lightingShader.bindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+    lightingShader.bindUniformBlock("ShadowData", SHADOW_UNIFORMS_BINDING);
+    lightCubeShader.use();
+    lightCubeShader.setInt("tex", 0);
+    lightCubeShader.bindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+
+    // dynamic resolution: the main pass renders into a target of its own at a scale the controller
+    // picks for the target frame time, then it is stretched over the output
+    bool dynamicResolution = options.dynamicResolution > 0.0;
+    ScaledTarget scaledTarget;
+    ResolutionController resolution;
+    resolution.TargetMs = options.dynamicResolution;
+    resolution.MinScale = options.minScale;
+
+    // benchmark bookkeeping
+    // ---------------------
+    FrameStats stats;
+    stats.shaderSetupMs = shaderSetupMs;
+    stats.programCacheHits = programCache.Hits;
+    stats.programCacheMisses = programCache.Misses;
+    stats.shaderVariants = materialShaders.Built;
+    stats.pointLights = (unsigned int)options.lights;
+    stats.shadowMode = options.shadows;
+    stats.resolutionTargetMs = options.dynamicResolution;
+    stats.submission = options.gpuCulling ? "gpu" : "cpu";
+    stats.sceneNodes = (unsigned int)scene.size();
+    stats.stressObjects = (unsigned int)stress.Objects;
+    stats.jobThreads = (unsigned int)jobs.size() + 1;
+    stats.reserve(options.frames);
+    GpuTimer gpuTimer;
+    gpuTimer.create();
+    GpuTimer shadowTimer;
+    shadowTimer.create();
+    unsigned int drawCalls = 0;
+    int frame = 0;
+    int lastFrameIndex = options.frames > 0 ? options.warmup + options.frames : 0;
+    FrameStats::Clock::time_point runStart = FrameStats::Clock::now();
+    FrameStats::Clock::time_point previousFrameStart = runStart;
+#ifdef COUNT_ALLOCATIONS
+    unsigned long long previousAllocations = 0;
+#endif
 
-            // Once we have copied the data over to the GPU, we can delete
-            // the data on the CPU side, since we won't be using it anymore
-            stbi_image_free(imageData);
-            imageData = nullptr;
+    // swap interval, frame limiter and frames in flight; without a swap chain the fences are all that
+    // throttles a headless run
+    PacingMode pacingMode = options.headless ? PACING_UNCAPPED : PACING_VSYNC;
+    if (options.pacing != nullptr)
+        parsePacingMode(options.pacing, pacingMode);
+    if (options.headless && (pacingMode == PACING_VSYNC || pacingMode == PACING_ADAPTIVE))
+    {
+        std::cout << "ERROR::FRAME_PACING::NO_SWAP_CHAIN: " << PACING_MODE_NAMES[pacingMode] << " needs a window, running uncapped" << std::endl;
+        pacingMode = PACING_UNCAPPED;
+    }
+    FramePacer pacer;
+    pacer.create(pacingMode, options.fpsLimit, options.framesInFlight, options.headless ? nullptr : window);
+
+    // the CPU side of a frame as a job graph: animation, torches, culling and filling the instance
+    // uploads, written into the commands of the frame being built
+    // ------------------------------------------------------------------------------------------
+    FrameCommands commands[2];
+    for (FrameCommands& frameCommands : commands)
+        frameCommands.arena.create(jobs.size() + 1, (size_t)options.frameArenaMb * 1024 * 1024);
+    FrameCommands* building = &commands[0];
+    float buildingTime = 0.0f;
+    JobGraph frameJobs;
+
+    // animate; only these nodes get their matrices rebuilt, the rest of the chamber stays cached
+    int animateJob = frameJobs.add([&]() {
+        PROFILE_ZONE("animate");
+        float sceneTime = buildingTime;
+        glm::vec3 lightPos(2.0f * sin(sceneTime), 2.0f, 3.0f + (2.5f * cos(sceneTime)));
+        building->lightPos = lightPos;
+        building->uniforms.lightPos = glm::vec4(lightPos, 1.0f);
+        building->uniforms.lightColor = glm::vec4(1.0f, 0.68f, 0.26f, 1.0f);
+        for (int i = 0; i < 3; i++)
+        {
+            scene.setRotation(rotatingCubes[2 * i], sceneTime * 2, glm::vec3(1.0f, 0.0f, 1.0f));
+            scene.setRotation(rotatingCubes[2 * i + 1], sceneTime * 3, glm::vec3(-1.0f, 0.0f, -1.0f));
+        }
+        scene.setPosition(lightCube, lightPos);
+        scene.setRotation(lightCube, sceneTime * 6, glm::vec3(0.0f, 1.0f, 0.0f));
+        stress.animate(scene, sceneTime);
+        scene.update();
+        octree.update(scene);
+    });
+
+    // move the torches and bin them into the light clusters of this view; needs nothing but the
+    // frame's time and camera, so it runs alongside everything else
+    frameJobs.add([&]() {
+        PROFILE_ZONE("bin lights");
+        FrameStats::Clock::time_point binningStart = FrameStats::Clock::now();
+        FrameUniforms& uniforms = building->uniforms;
+        if (options.lights > 0)
+        {
+            for (int i = 0; i < options.lights; i++)
+            {
+                float angle = buildingTime * torchDrift[i].x + torchDrift[i].y;
+                pointLights[i].Position = torchBase[i] + torchDrift[i].z * glm::vec3(cos(angle), 0.5f * sin(2.0f * angle), sin(angle));
+            }
+            if (uniforms.projection != clusterProjection)
+            {
+                clusterProjection = uniforms.projection;
+                clusteredLights.setProjection(clusterProjection, 0.1f, 100.0f);
+            }
+            clusteredLights.update(pointLights, uniforms.view, &jobs, building->clusters);
+        }
+        uniforms.clusterTiles = clusteredLights.tileParameters(building->renderWidth, building->renderHeight);
+        uniforms.clusterSlices = clusteredLights.sliceParameters(building->clusters);
+        building->binningMs = FrameStats::milliseconds(binningStart, FrameStats::Clock::now());
+    });
+
+    // frustum culling, then occlusion culling; only what survives goes into the instance buffers
+    int cullJob = frameJobs.add([&]() {
+        PROFILE_ZONE("cull");
+        if (options.gpuCulling)
+        {
+            building->visible = building->culled = building->occluded = 0;
+            building->occlusionMs = 0.0;
+            return;
+        }
+        glm::mat4 viewProjection = building->uniforms.projection * building->uniforms.view;
+        visibleNodes.clear();
+        octree.cull(scene, Frustum(viewProjection), visibleNodes);
+        unsigned int frustumVisible = (unsigned int)visibleNodes.size();
+        building->occluded = 0;
+        FrameStats::Clock::time_point occlusionStart = FrameStats::Clock::now();
+        if (options.occlusionCulling)
+        {
+            occlusionCuller.render(scene, viewProjection);
+            building->occluded = occlusionCuller.cull(scene, visibleNodes);
+        }
+        building->occlusionMs = FrameStats::milliseconds(occlusionStart, FrameStats::Clock::now());
+        building->visible = (unsigned int)visibleNodes.size();
+        building->culled = (unsigned int)octree.size() - frustumVisible;
+        std::fill(nodeVisible.begin(), nodeVisible.end(), 0);
+        for (int id : visibleNodes)
+            nodeVisible[id] = 1;
+    });
+    int litJob = frameJobs.add([&]() {
+        PROFILE_ZONE("gather lit");
+        if (!options.gpuCulling)
+            litBatch.gather(scene, nodeVisible, building->lit);
+    });
+    int emissiveJob = frameJobs.add([&]() {
+        PROFILE_ZONE("gather emissive");
+        if (!options.gpuCulling)
+            emissiveBatch.gather(scene, nodeVisible, building->emissive);
+    });
+
+    // or, on the GPU-driven path, the objects that moved; culling happens on the GPU
+    int objectsJob = frameJobs.add([&]() {
+        PROFILE_ZONE("gather objects");
+        if (options.gpuCulling)
+            gpuCuller.gather(scene, building->objects);
+    });
+
+    // the moving shadow casters, all of them whether visible or not
+    int castersJob = frameJobs.add([&]() {
+        PROFILE_ZONE("gather shadow casters");
+        if (!shadowsEnabled)
+            return;
+        dynamicCasters.gather(scene, allNodes, building->dynamicCasters);
+        building->dynamicCasterBounds.resize(dynamicCasterNodes.size());
+        for (size_t i = 0; i < dynamicCasterNodes.size(); i++)
+        {
+            building->dynamicCasterBounds[i].center = scene.WorldCenter[dynamicCasterNodes[i]];
+            building->dynamicCasterBounds[i].extent = scene.WorldExtent[dynamicCasterNodes[i]];
+        }
+    });
+
+    // the main pass's draws, sorted by program, texture, vertex array and nearest depth
+    int queueJob = frameJobs.add([&]() {
+        PROFILE_ZONE("build render queue");
+        const glm::mat4& view = building->uniforms.view;
+        std::function<float(const InstanceBatch&)> nearestDepth = [&](const InstanceBatch& batch) {
+            float nearest = 100.0f;
+            for (int node : batch.DrawnNodes)
+            {
+                glm::vec3 extent = scene.WorldExtent[node];
+                float depth = -(view * glm::vec4(scene.WorldCenter[node], 1.0f)).z - std::max(extent.x, std::max(extent.y, extent.z));
+                nearest = std::min(nearest, depth);
+            }
+            return (nearest - 0.1f) / (100.0f - 0.1f);
+        };
+        RenderQueue& queue = building->queue;
+        queue.clear();
+        if (options.gpuCulling)
+            return;
+        queue.add("draw lit", lightingShader.ID, GL_TEXTURE_2D_ARRAY, textures.ID, cubeVAO, cubeMesh, building->lit.count, nearestDepth(litBatch));
+        queue.add("draw emissive", lightCubeShader.ID, GL_TEXTURE_2D_ARRAY, textures.ID, lightCubeVAO, cubeMesh, building->emissive.count, nearestDepth(emissiveBatch));
+        queue.sort();
+    });
+    frameJobs.depend(cullJob, animateJob);
+    frameJobs.depend(litJob, cullJob);
+    frameJobs.depend(emissiveJob, cullJob);
+    frameJobs.depend(castersJob, animateJob);
+    frameJobs.depend(objectsJob, animateJob);
+    frameJobs.depend(queueJob, litJob);
+    frameJobs.depend(queueJob, emissiveJob);
+
+    // starts building frame index: the input is applied to the camera now, the rest happens on the jobs.
+    // A replay takes the input and time of the frame from the recording instead. Input is sampled (the
+    // events polled) right before, after the frame pacer's wait, so it is as fresh as it can be when
+    // the view matrix is built from it.
+    FrameStats::Clock::time_point simulateStart;
+    float previousTime = 0.0f;
+    int outputWidth = framebufferWidth, outputHeight = framebufferHeight;
+    std::function<void(int)> launchFrame = [&](int index) {
+        building = &commands[index % 2];
+        building->reset();
+
+        // follow the window's size (a minimized one keeps the last); the cull buffer has its aspect ratio
+        if (framebufferWidth > 0 && framebufferHeight > 0 && (framebufferWidth != outputWidth || framebufferHeight != outputHeight))
+        {
+            outputWidth = framebufferWidth;
+            outputHeight = framebufferHeight;
+            occlusionCuller.create(256, outputWidth, outputHeight, &jobs);
+        }
+        building->outputWidth = outputWidth;
+        building->outputHeight = outputHeight;
+        building->scale = dynamicResolution ? resolution.Scale : 1.0f;
+        building->renderWidth = dynamicResolution ? ResolutionController::renderSize(outputWidth, building->scale) : outputWidth;
+        building->renderHeight = dynamicResolution ? ResolutionController::renderSize(outputHeight, building->scale) : outputHeight;
+
+        InputRecord input = frameInput;
+        frameInput = InputRecord();
+        if (options.replay != nullptr)
+        {
+            input = recording.Frames[index];
         }
         else
         {
-            std::cerr << "Failed to load image" << std::endl;
+            // headless runs advance a fixed simulated timestep so every run animates identically
+            input.time = options.headless ? index * options.timestep : (float)glfwGetTime();
+            input.deltaTime = index > 0 ? input.time - previousTime : 0.0f;
+            previousTime = input.time;
         }
+        building->input = input;
+        building->inputTime = FrameStats::Clock::now();
+        applyInput(input);
+        buildingTime = input.time;
+        building->uniforms.projection = glm::perspective(glm::radians(camera.Zoom), (float)outputWidth / (float)outputHeight, 0.1f, 100.0f);
+        building->uniforms.view = camera.GetViewMatrix();
+        building->uniforms.viewPos = glm::vec4(camera.Position, 1.0f);
+        simulateStart = FrameStats::Clock::now();
+        jobs.launch(frameJobs);
+    };
+    // unless every frame is built right after its input, frame 0 is built ahead like every next one is
+    if (!options.lateInput)
+    {
+        launchFrame(0);
+        jobs.wait(frameJobs);
     }
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    while (options.headless ? frame < lastFrameIndex : !glfwWindowShouldClose(window))
     {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        // the trace covers startup and the first profileFrames frames
+#ifdef PROFILING
+        if (Profiler::get().isRecording() && frame >= options.profileFrames)
+        {
+            Profiler::get().stop();
+            Profiler::get().writeTrace(options.profile);
+        }
+#endif
+        PROFILE_ZONE("frame");
+
+        // at most framesInFlight frames queued on the GPU, and at the limiter's rate; the frame's time
+        // starts after the wait, the frame-to-frame interval includes it
+        pacer.beginFrame();
+        FrameStats::Clock::time_point frameStart = FrameStats::Clock::now();
+        bool measured = options.frames > 0 && frame >= options.warmup;
+        double previousFrameMs = FrameStats::milliseconds(previousFrameStart, frameStart);
+        if (frame == options.warmup)
+            runStart = frameStart;
+        else if (measured)
+            stats.frameMs.push_back(previousFrameMs);
+        previousFrameStart = frameStart;
+#ifdef COUNT_ALLOCATIONS
+        unsigned long long allocations = heapAllocations();
+        if (measured && frame > options.warmup)
+            stats.heapAllocations.push_back(allocations - previousAllocations);
+        previousAllocations = allocations;
+#endif
+
+        // the frame launched next renders at the scale the last frame's time asks for; the warm-up
+        // frames (shader compilation, texture streaming) would only drive it down for nothing
+        if (dynamicResolution && frame > options.warmup)
+            resolution.update(previousFrameMs);
 
         // input
         // -----
-        processInput(window);
+        // glfw: poll IO events (keys pressed/released, mouse moved etc.) as late as possible, just
+        // before they turn into a view matrix
+        if (!options.headless)
+        {
+            glfwPollEvents();
+            processInput(window);
+        }
+
+        // the jobs build the next frame while this one is submitted; with late input this frame is
+        // built now from the input just sampled, a frame less latency for no overlap
+        double simulateMs = 0.0;
+        bool buildNext = !options.lateInput && (lastFrameIndex == 0 || frame + 1 < lastFrameIndex);
+        if (options.lateInput)
+        {
+            launchFrame(frame);
+            PROFILE_ZONE("wait for jobs");
+            jobs.wait(frameJobs);
+            simulateMs = FrameStats::milliseconds(simulateStart, frameJobs.Finished);
+        }
+        else if (buildNext)
+        {
+            launchFrame(frame + 1);
+        }
+        FrameCommands& current = commands[frame % 2];
+
+        // recorded once the frame is submitted: the one built ahead when the window closes never is
+        if (options.record != nullptr)
+            recording.Frames.push_back(current.input);
+        FrameStats::Clock::time_point submitStart = FrameStats::Clock::now();
+
+        // textures that finished decoding since the last frame; the streamer binds the array and its
+        // buffers itself
+        stateCache.resetCounters();
+        if (!textureStreamer.done())
+        {
+            textureStreamer.update();
+            stateCache.invalidate();
+        }
+        if (stats.texturesReadyMs < 0.0 && textureStreamer.done())
+            stats.texturesReadyMs = FrameStats::milliseconds(processStart, FrameStats::Clock::now());
 
         // render
         // ------
+        // view/projection transformations and the light, written once for both programs
+        frameRing.beginFrame();
+        size_t uniformsOffset;
+        if (frameRing.write(&current.uniforms, sizeof(FrameUniforms), uniformAlignment, uniformsOffset))
+            glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, frameRing.Buffer, uniformsOffset, sizeof(FrameUniforms));
+        if (options.lights > 0)
+        {
+            clusteredLights.upload(current.clusters);
+            clusteredLights.bind(LIGHT_CLUSTER_TEXTURE_UNIT, stateCache);
+        }
+        litBatch.upload(current.lit, &frameRing);
+        emissiveBatch.upload(current.emissive, &frameRing);
+        if (options.gpuCulling)
+        {
+            PROFILE_GPU_ZONE("gpu cull");
+            gpuCuller.upload(current.objects, &frameRing);
+            gpuCuller.cull(stateCache, *cullShader, current.uniforms.projection * current.uniforms.view);
+        }
+
+        // shadow maps, timed on their own
+        double shadowMs = 0.0;
+        if (shadowsEnabled)
+        {
+            PROFILE_ZONE("shadow maps");
+            PROFILE_GPU_ZONE("shadow maps");
+            FrameStats::Clock::time_point shadowStart = FrameStats::Clock::now();
+            dynamicCasters.upload(current.dynamicCasters, &frameRing);
+            shadowAtlas.setDynamicCasters(current.dynamicCasterBounds);
+            shadowAtlas.setPosition(0, current.lightPos);
+            shadowTimer.begin();
+            stateCache.useProgram(shadowShader.ID);
+            shadowAtlas.render(stateCache, shadowViewProjection, drawStaticCasters, drawDynamicCasters);
+            shadowTimer.end();
+            shadowMs = FrameStats::milliseconds(shadowStart, FrameStats::Clock::now());
+        }
+
+        gpuTimer.begin();
+
+        // the main pass goes into the scaled target, or straight into the output at full size
+        unsigned int outputFramebuffer = options.headless ? offscreen.FBO : 0;
+        if (dynamicResolution)
+        {
+            if (scaledTarget.Width != current.outputWidth || scaledTarget.Height != current.outputHeight)
+            {
+                scaledTarget.destroy();
+                scaledTarget.create(current.outputWidth, current.outputHeight);
+            }
+            scaledTarget.bind(current.renderWidth, current.renderHeight);
+        }
+        else
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+            glViewport(0, 0, current.outputWidth, current.outputHeight);
+        }
+
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        float lightX = 2.0f * sin(glfwGetTime());
-        float lightY = 2.0f;
-        float lightZ = 3.0f + (2.5f * cos(glfwGetTime()));
-        glm::vec3 lightPos = glm::vec3(lightX, lightY, lightZ);
+        // every visible lit object in one draw, the lamp in another
+        drawCalls = options.gpuCulling ? drawIndirect() : current.queue.submit(stateCache, 0);
 
-        // be sure to activate shader when setting uniforms/drawing objects
-        lightingShader.use();
-        lightingShader.setVec3("objectColor", 0.01f, 0.01f, 0.01f);
-        lightingShader.setVec3("lightColor", 1.0f, 0.68f, 0.26f);
-        lightingShader.setVec3("lightPos", lightPos);
-        lightingShader.setVec3("viewPos", camera.Position);
-
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
-
-        //Table
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::scale(model, glm::vec3(4.0f, 0.1f, 4.0f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 0);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(1.8f, -1.5f, 1.8f));
-        model = glm::scale(model, glm::vec3(0.2f, -3.0f, 0.2f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 0);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.8f, -1.5f, 1.8f));
-        model = glm::scale(model, glm::vec3(0.2f, -3.0f, 0.2f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 0);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(1.8f, -1.5f, -1.8f));
-        model = glm::scale(model, glm::vec3(0.2f, -3.0f, 0.2f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 0);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.8f, -1.5f, -1.8f));
-        model = glm::scale(model, glm::vec3(0.2f, -3.0f, 0.2f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 0);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-
-        //Walls and Floors
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 1.0f, -4.0f));
-        model = glm::scale(model, glm::vec3(8.0f, 8.0f, 0.1f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 3);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-4.0f, 1.0f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 8.0f, 10.0f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 3);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(4.0f, 1.0f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 8.0f, 10.0f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 3);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -3.0f, 1.0f));
-        model = glm::scale(model, glm::vec3(8.0f, 0.1f, 10.0f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 3);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 5.0f, 1.0f));
-        model = glm::scale(model, glm::vec3(8.0f, 0.1f, 10.0f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 3);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 1.0f, 6.0f));
-        model = glm::scale(model, glm::vec3(8.0f, 8.0f, 0.1f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 3);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-
-        //Banner
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 2.0f, -3.5f));
-        model = glm::scale(model, glm::vec3(4.0f, 4.0f, 0.1f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 1);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        //Rotating Cubes
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 2.0f, 0.0f));
-        model = glm::rotate(model, float(glfwGetTime())*2, glm::vec3(1.0f, 0.0f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 0);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 2.0f, 0.0f));
-        model = glm::rotate(model, float(glfwGetTime()) *3, glm::vec3(-1.0f, 0.0f, -1.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 0);
-
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(2.0f, 2.0f, 1.0f));
-        model = glm::rotate(model, float(glfwGetTime()) * 2, glm::vec3(1.0f, 0.0f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 0);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(2.0f, 2.0f, 1.0f));
-        model = glm::rotate(model, float(glfwGetTime()) * 3, glm::vec3(-1.0f, 0.0f, -1.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 0);
-
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-2.0f, 2.0f, 1.0f));
-        model = glm::rotate(model, float(glfwGetTime()) * 2, glm::vec3(1.0f, 0.0f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 0);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-2.0f, 2.0f, 1.0f));
-        model = glm::rotate(model, float(glfwGetTime()) * 3, glm::vec3(-1.0f, 0.0f, -1.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-        lightingShader.setMat4("model", model);
-        lightingShader.setInt("tex", 0);
-
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // also draw the lamp object
-        lightCubeShader.use();
-        lightCubeShader.setVec3("lightColor", 1.0f, 0.68f, 0.26f);
-        lightCubeShader.setMat4("projection", projection);
-        lightCubeShader.setMat4("view", view);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, lightPos);
-        model = glm::rotate(model, float(glfwGetTime()) * 6, glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.2f)); // a smaller cube
-        lightCubeShader.setMat4("model", model);
-        lightCubeShader.setInt("tex", 2);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (dynamicResolution)
+        {
+            PROFILE_GPU_ZONE("upscale");
+            scaledTarget.upscale(outputFramebuffer, current.renderWidth, current.renderHeight, current.outputWidth, current.outputHeight);
+        }
+
+        gpuTimer.end();
+        frameRing.endFrame();
+        double submitMs = FrameStats::milliseconds(submitStart, FrameStats::Clock::now());
+
+        // help with the next frame's jobs until they are done
+        if (buildNext)
+        {
+            PROFILE_ZONE("wait for jobs");
+            jobs.wait(frameJobs);
+            simulateMs = FrameStats::milliseconds(simulateStart, frameJobs.Finished);
+        }
+
+        double cpuMs = FrameStats::milliseconds(frameStart, FrameStats::Clock::now());
+        if (frame == 0)
+        {
+            // time to first frame: until the GPU has actually finished drawing it
+            glFinish();
+            stats.timeToFirstFrameMs = FrameStats::milliseconds(processStart, FrameStats::Clock::now());
+        }
+        if (measured)
+        {
+            stats.addFrame(cpuMs, drawCalls);
+            stats.addJobs(simulateMs, submitMs);
+            stats.resolutionScale.push_back(current.scale);
+            stats.addStateChanges(stateCache.Issued, stateCache.Skipped);
+            stats.addCulling(current.visible, current.culled, current.occluded, current.occlusionMs);
+            stats.addLighting(current.clusters.IndexCount, current.binningMs);
+            stats.addShadows(shadowAtlas.FacesRendered, shadowAtlas.FacesComposited, shadowAtlas.StaticFacesRendered, shadowAtlas.DrawCalls, shadowMs);
+            size_t lightBufferBytes = current.clusters.packed.size() * sizeof(glm::vec4) +
+                                      (current.clusters.grid.size() + current.clusters.indices.size()) * sizeof(uint32_t);
+            size_t heapBytes = gpuMemory.stats().capacity + frameRing.RegionSize * GpuRingBuffer::FRAMES;
+            stats.gpuBuffersMb = std::max(stats.gpuBuffersMb, (heapBytes + lightBufferBytes) / (1024.0 * 1024.0));
+            gpuTimer.collect(stats.gpuMs);
+            shadowTimer.collect(stats.shadowGpuMs);
+            stats.addPacing(pacer.FenceWaitMs, pacer.LimiterWaitMs);
+        }
+        else
+        {
+            // warm-up frames (shader compilation, first-use driver work) are not part of the measurement
+            std::vector<double> discarded;
+            gpuTimer.collect(discarded, true);
+            shadowTimer.collect(discarded, true);
+        }
+#ifdef PROFILING
+        if (Profiler::get().isRecording())
+            Profiler::get().collectGpu();
+#endif
+
+        // glfw: swap buffers, then the pacer timestamps the frame's end and fences it
+        // ---------------------------------------------------------------------------
+        if (!options.headless)
+        {
+            PROFILE_ZONE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
+        pacer.endFrame(current.inputTime, measured);
+        pacer.collect(stats.inputLatencyMs);
+        frame++;
+        if (lastFrameIndex > 0 && frame >= lastFrameIndex)
+            break;
+
+        // the render scale, the frame time it led to and the input latency, twice a second at 60 Hz
+        if (!options.headless && frame % 30 == 0)
+        {
+            char title[128];
+            if (dynamicResolution)
+                snprintf(title, sizeof title, "Torture Chamber - %d%% resolution, %.1f ms, %.1f ms input latency",
+                         (int)std::lround(current.scale * 100.0f), previousFrameMs, pacer.LatencyMs);
+            else
+                snprintf(title, sizeof title, "Torture Chamber - %.1f ms, %.1f ms input latency", previousFrameMs, pacer.LatencyMs);
+            glfwSetWindowTitle(window, title);
+        }
+    }
+
+    // or as much of them as the run had
+#ifdef PROFILING
+    if (Profiler::get().isRecording())
+    {
+        Profiler::get().stop();
+        Profiler::get().writeTrace(options.profile);
     }
+#endif
+
+    // report benchmark results once the GPU has finished every submitted frame
+    // ------------------------------------------------------------------------
+    if (options.frames > 0)
+    {
+        glFinish();
+        stats.totalMs = FrameStats::milliseconds(runStart, FrameStats::Clock::now());
+        stats.peakResidentMb = FrameStats::peakResidentMegabytes();
+        gpuTimer.collect(stats.gpuMs, true);
+        shadowTimer.collect(stats.shadowGpuMs, true);
+        pacer.collect(stats.inputLatencyMs, true);
+        stats.setPacing(PACING_MODE_NAMES[pacer.Mode], pacer.SwapInterval, pacer.FpsLimit, pacer.FramesInFlight, options.lateInput);
+        stats.setGpuMemory(gpuMemory.stats(), gpuMemory.isImmutable(), frameRing);
+        for (FrameCommands& frameCommands : commands)
+            stats.addFrameArena(frameCommands.arena);
+
+        std::string renderer = (const char*)glGetString(GL_RENDERER);
+        if (options.output != nullptr)
+        {
+            std::ofstream out(options.output);
+            stats.writeJson(out, renderer, options.width, options.height, options.timestep);
+        }
+        else
+        {
+            stats.writeJson(std::cout, renderer, options.width, options.height, options.timestep);
+        }
+        if (options.frameLog != nullptr)
+        {
+            std::ofstream log(options.frameLog);
+            if (log)
+                stats.writeFrameCsv(log, options.warmup);
+            else
+                std::cout << "ERROR::FRAME_LOG::WRITE_FAILED: " << options.frameLog << std::endl;
+        }
+    }
+    if (options.record != nullptr)
+        recording.save(options.record);
+    gpuTimer.destroy();
+    shadowTimer.destroy();
+    jobs.stop();
+    loaderPool.stop();
+    textureStreamer.destroy();
+    pack.close();
+    if (dynamicResolution)
+        scaledTarget.destroy();
+    pacer.destroy();
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteVertexArrays(1, &lightCubeVAO);
-    glDeleteBuffers(1, &VBO);
+    cubeMesh.destroy();
+    litBatch.destroy();
+    emissiveBatch.destroy();
+    glDeleteVertexArrays(2, casterVAOs);
+    staticCasters.destroy();
+    dynamicCasters.destroy();
+    gpuCuller.destroy();
+    gpuMemory.destroy();
+    frameRing.destroy();
+    if (shadowsEnabled)
+        shadowAtlas.destroy();
+    textures.destroy();
+    clusteredLights.destroy();
+
+    if (options.headless)
+    {
+        offscreen.destroy();
+        headlessContext.destroy();
+    }
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -475,6 +1154,160 @@ int main()
     return 0;
 }
 
+// parse the command line; returns false (after printing usage) on unknown or malformed arguments
+// ---------------------------------------------------------------------------------------------
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--headless") == 0)
+            options.headless = true;
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+            options.frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+            options.warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--timestep") == 0 && hasValue)
+            options.timestep = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--width") == 0 && hasValue)
+            options.width = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--height") == 0 && hasValue)
+            options.height = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--output") == 0 && hasValue)
+            options.output = argv[++i];
+        else if (strcmp(argv[i], "--shader-cache") == 0 && hasValue)
+            options.shaderCache = argv[++i];
+        else if (strcmp(argv[i], "--no-shader-cache") == 0)
+            options.shaderCache = nullptr;
+        else if (strcmp(argv[i], "--no-occlusion-culling") == 0)
+            options.occlusionCulling = false;
+        else if (strcmp(argv[i], "--lights") == 0 && hasValue)
+            options.lights = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--shadows") == 0 && hasValue)
+            options.shadows = argv[++i];
+        else if (strcmp(argv[i], "--shadow-budget") == 0 && hasValue)
+            options.shadowBudget = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+            options.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--profile") == 0 && hasValue)
+            options.profile = argv[++i];
+        else if (strcmp(argv[i], "--profile-frames") == 0 && hasValue)
+            options.profileFrames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--record") == 0 && hasValue)
+            options.record = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && hasValue)
+            options.replay = argv[++i];
+        else if (strcmp(argv[i], "--frame-log") == 0 && hasValue)
+            options.frameLog = argv[++i];
+        else if (strcmp(argv[i], "--dynamic-resolution") == 0 && hasValue)
+            options.dynamicResolution = atof(argv[++i]);
+        else if (strcmp(argv[i], "--min-scale") == 0 && hasValue)
+            options.minScale = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--pack") == 0 && hasValue)
+            options.pack = argv[++i];
+        else if (strcmp(argv[i], "--stress-objects") == 0 && hasValue)
+            options.stressObjects = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--stress-grid") == 0 && hasValue)
+            options.stressGrid = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--gpu-culling") == 0)
+            options.gpuCulling = true;
+        else if (strcmp(argv[i], "--frame-arena") == 0 && hasValue)
+            options.frameArenaMb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pacing") == 0 && hasValue)
+            options.pacing = argv[++i];
+        else if (strcmp(argv[i], "--fps-limit") == 0 && hasValue)
+            options.fpsLimit = atof(argv[++i]);
+        else if (strcmp(argv[i], "--frames-in-flight") == 0 && hasValue)
+            options.framesInFlight = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--late-input") == 0)
+            options.lateInput = true;
+        else
+        {
+            std::cout << "Usage: " << argv[0] << " [--headless] [--frames N] [--warmup N] [--timestep SECONDS]"
+                      << " [--width W] [--height H] [--output FILE.json] [--shader-cache DIR | --no-shader-cache]"
+                      << " [--no-occlusion-culling] [--lights N] [--shadows off|naive|cached] [--shadow-budget FACES]"
+                      << " [--threads N] [--profile FILE.json] [--profile-frames N] [--record FILE | --replay FILE]"
+                      << " [--frame-log FILE.csv] [--stress-objects N] [--stress-grid N] [--pack FILE.pack]"
+                      << " [--dynamic-resolution TARGET_MS] [--min-scale S] [--gpu-culling] [--frame-arena MB]"
+                      << " [--pacing vsync|adaptive|uncapped|limit] [--fps-limit FPS] [--frames-in-flight N] [--late-input]" << std::endl;
+            return false;
+        }
+    }
+
+    // a headless run always is a benchmark run
+    if (options.headless && options.frames <= 0)
+        options.frames = 600;
+    if (options.warmup < 0)
+        options.warmup = 0;
+    if (options.width <= 0 || options.height <= 0 || options.timestep <= 0.0f || options.lights < 0 || options.threads < 0 ||
+        options.stressObjects < 0 || options.stressGrid < 1 || options.frameArenaMb < 1)
+    {
+        std::cout << "Invalid --width, --height, --timestep, --lights, --threads, --stress-objects, --stress-grid or --frame-arena" << std::endl;
+        return false;
+    }
+    if ((strcmp(options.shadows, "off") != 0 && strcmp(options.shadows, "naive") != 0 && strcmp(options.shadows, "cached") != 0) ||
+        options.shadowBudget < 1)
+    {
+        std::cout << "Invalid --shadows or --shadow-budget" << std::endl;
+        return false;
+    }
+    if (options.dynamicResolution < 0.0 || options.minScale <= 0.0f || options.minScale > 1.0f)
+    {
+        std::cout << "Invalid --dynamic-resolution or --min-scale" << std::endl;
+        return false;
+    }
+    // --fps-limit alone means the limit mode
+    PacingMode pacingMode = PACING_VSYNC;
+    if (options.pacing == nullptr && options.fpsLimit > 0.0)
+        options.pacing = PACING_MODE_NAMES[PACING_LIMIT];
+    if ((options.pacing != nullptr && !parsePacingMode(options.pacing, pacingMode)) || options.fpsLimit < 0.0 ||
+        (pacingMode == PACING_LIMIT) != (options.fpsLimit > 0.0) || options.framesInFlight < 1 ||
+        options.framesInFlight > FramePacer::MAX_FRAMES_IN_FLIGHT)
+    {
+        std::cout << "Invalid --pacing, --fps-limit (limit mode only) or --frames-in-flight (1 to " << FramePacer::MAX_FRAMES_IN_FLIGHT << ")" << std::endl;
+        return false;
+    }
+    if (options.record != nullptr && options.replay != nullptr)
+    {
+        std::cout << "--record and --replay can not be combined" << std::endl;
+        return false;
+    }
+#ifndef PROFILING
+    if (options.profile != nullptr)
+    {
+        std::cout << "--profile needs a build with PROFILING defined" << std::endl;
+        return false;
+    }
+#endif
+    return true;
+}
+
+// a program's vertex and fragment stage from the asset pack if it holds them, otherwise from the loose files
+// -------------------------------------------------------------------------------------------------------
+ShaderSources loadShaderSources(const AssetPack& pack, const char* vertexPath, const char* fragmentPath)
+{
+    const AssetPackEntry* vertex = pack.find(vertexPath);
+    const AssetPackEntry* fragment = pack.find(fragmentPath);
+    if (vertex == NULL || fragment == NULL)
+        return Shader::readSources(vertexPath, fragmentPath);
+    ShaderSources sources;
+    sources.vertex = pack.text(*vertex);
+    sources.fragment = pack.text(*fragment);
+    return sources;
+}
+
+// a compute program from the asset pack if it holds it, otherwise from the loose file
+// ---------------------------------------------------------------------------------
+ShaderSources loadComputeSource(const AssetPack& pack, const char* computePath)
+{
+    const AssetPackEntry* compute = pack.find(computePath);
+    if (compute == NULL)
+        return Shader::readComputeSource(computePath);
+    ShaderSources sources;
+    sources.compute = pack.text(*compute);
+    return sources;
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow* window)
@@ -482,23 +1315,43 @@ void processInput(GLFWwindow* window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    frameInput.keys = 0;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        frameInput.keys |= INPUT_KEY_FORWARD;
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        frameInput.keys |= INPUT_KEY_BACKWARD;
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        frameInput.keys |= INPUT_KEY_LEFT;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        frameInput.keys |= INPUT_KEY_RIGHT;
+}
+
+// moves the camera by one frame's input, recorded or live
+// -------------------------------------------------------
+void applyInput(const InputRecord& input)
+{
+    if (input.mouse[0] != 0.0f || input.mouse[1] != 0.0f)
+        camera.ProcessMouseMovement(input.mouse[0], input.mouse[1]);
+    if (input.scroll != 0.0f)
+        camera.ProcessMouseScroll(input.scroll);
+    if (input.keys & INPUT_KEY_FORWARD)
+        camera.ProcessKeyboard(FORWARD, input.deltaTime);
+    if (input.keys & INPUT_KEY_BACKWARD)
+        camera.ProcessKeyboard(BACKWARD, input.deltaTime);
+    if (input.keys & INPUT_KEY_LEFT)
+        camera.ProcessKeyboard(LEFT, input.deltaTime);
+    if (input.keys & INPUT_KEY_RIGHT)
+        camera.ProcessKeyboard(RIGHT, input.deltaTime);
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-    // make sure the viewport matches the new window dimensions; note that width and 
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    // the next frame launched renders at this size (the viewport is set per frame); note that width
+    // and height will be significantly larger than specified on retina displays.
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
 
 
@@ -519,13 +1372,14 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     lastX = xpos;
     lastY = ypos;
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    frameInput.mouse[0] += xoffset;
+    frameInput.mouse[1] += yoffset;
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(yoffset);
+    frameInput.scroll += (float)yoffset;
 }
 
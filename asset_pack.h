@@ -0,0 +1,235 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "asset_pack_format.h"
+
+// A read-only file mapped into memory. Pages are read in on first touch and belong to the page
+// cache, so nothing is copied onto the heap and untouched parts of the file cost nothing.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    // returns false without a message if the file does not exist
+    bool open(const char* path)
+    {
+        close();
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+        {
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping != NULL)
+                bytes = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            length = bytes != NULL ? (size_t)fileSize.QuadPart : 0;
+        }
+        CloseHandle(file);
+#else
+        int file = ::open(path, O_RDONLY);
+        if (file < 0)
+            return false;
+        struct stat status;
+        if (fstat(file, &status) == 0 && status.st_size > 0)
+        {
+            void* mapped = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapped != MAP_FAILED)
+            {
+                bytes = (const char*)mapped;
+                length = (size_t)status.st_size;
+            }
+        }
+        ::close(file);
+#endif
+        if (bytes == NULL)
+            std::cout << "ERROR::MAPPED_FILE::MAP_FAILED: " << path << std::endl;
+        return bytes != NULL;
+    }
+
+    void close()
+    {
+#if defined(_WIN32)
+        if (bytes != NULL)
+            UnmapViewOfFile(bytes);
+        if (mapping != NULL)
+            CloseHandle(mapping);
+        mapping = NULL;
+#else
+        if (bytes != NULL)
+            munmap((void*)bytes, length);
+#endif
+        bytes = NULL;
+        length = 0;
+    }
+
+    const char* data() const
+    {
+        return bytes;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+    // asks the OS to start reading a range in, so a later touch does not wait for the disk
+    void prefetch(size_t offset, size_t size) const
+    {
+#if !defined(_WIN32)
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t begin = offset / page * page;
+        madvise((void*)(bytes + begin), offset + size - begin, MADV_WILLNEED);
+#endif
+    }
+
+    // gives the pages wholly inside a range back; touching them again reads them in again
+    void release(size_t offset, size_t size) const
+    {
+#if !defined(_WIN32)
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t begin = (offset + page - 1) / page * page;
+        size_t end = (offset + size) / page * page;
+        if (end > begin)
+            madvise((void*)(bytes + begin), end - begin, MADV_DONTNEED);
+#endif
+    }
+
+private:
+    const char* bytes = NULL;
+    size_t length = 0;
+#if defined(_WIN32)
+    HANDLE mapping = NULL;
+#endif
+};
+
+// The asset archive built by tools/packc, mapped as a whole. Entries are found by the path of the
+// loose file they were packed from and point straight into the mapping, so meshes and textures are
+// uploaded from the page cache without being read into a buffer first.
+class AssetPack
+{
+public:
+    // returns false without a message if the file does not exist, so callers can use the loose files
+    bool open(const char* path)
+    {
+        entries = NULL;
+        count = 0;
+        if (!file.open(path))
+            return false;
+
+        AssetPackHeader header;
+        if (file.size() < sizeof header)
+            return invalid(path);
+        memcpy(&header, file.data(), sizeof header);
+        if (memcmp(header.magic, ASSET_PACK_MAGIC, sizeof header.magic) != 0 || header.version != ASSET_PACK_VERSION ||
+            header.fileSize != file.size() || header.tableOffset % alignof(AssetPackEntry) != 0 ||
+            header.tableOffset > file.size() || (uint64_t)header.entryCount * sizeof(AssetPackEntry) > file.size() - header.tableOffset)
+            return invalid(path);
+        entries = (const AssetPackEntry*)(file.data() + header.tableOffset);
+        count = header.entryCount;
+        // ranges are checked without adding offset and size, which a corrupt header could make wrap around
+        for (uint32_t i = 0; i < count; i++)
+            if (entries[i].offset > file.size() || entries[i].size > file.size() - entries[i].offset || entries[i].name[ASSET_PACK_NAME_SIZE - 1] != '\0')
+                return invalid(path);
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        entries = NULL;
+        count = 0;
+    }
+
+    bool isOpen() const
+    {
+        return entries != NULL;
+    }
+
+    // the entry packed from the loose file at path, NULL if there is none
+    const AssetPackEntry* find(const std::string& path) const
+    {
+        const AssetPackEntry* end = entries + count;
+        const AssetPackEntry* entry = std::lower_bound(entries, end, path, [](const AssetPackEntry& e, const std::string& name) {
+            return strcmp(e.name, name.c_str()) < 0;
+        });
+        return entry != end && path == entry->name ? entry : NULL;
+    }
+
+    // the entry's bytes, valid as long as the pack is open
+    const char* data(const AssetPackEntry& entry) const
+    {
+        return file.data() + entry.offset;
+    }
+
+    // the bytes of a text entry, e.g. a shader, as a string
+    std::string text(const AssetPackEntry& entry) const
+    {
+        return std::string(data(entry), (size_t)entry.size);
+    }
+
+    void prefetch(const AssetPackEntry& entry) const
+    {
+        file.prefetch((size_t)entry.offset, (size_t)entry.size);
+    }
+
+    // once an entry has been uploaded, its pages no longer need to stay resident
+    void release(const AssetPackEntry& entry) const
+    {
+        file.release((size_t)entry.offset, (size_t)entry.size);
+    }
+
+    // recomputes the content hash; reads the whole entry
+    bool verify(const AssetPackEntry& entry) const
+    {
+        return assetPackHash(data(entry), (size_t)entry.size) == entry.hash;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    const AssetPackEntry& entry(size_t index) const
+    {
+        return entries[index];
+    }
+
+private:
+    MappedFile file;
+    const AssetPackEntry* entries = NULL;
+    uint32_t count = 0;
+
+    bool invalid(const char* path)
+    {
+        std::cout << "ERROR::ASSET_PACK::INVALID_FILE: " << path << " (rebuild it with tools/packc)" << std::endl;
+        close();
+        return false;
+    }
+};
+#endif
@@ -0,0 +1,54 @@
+#ifndef ASSET_PACK_FORMAT_H
+#define ASSET_PACK_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Asset archive written by tools/packc and mapped by AssetPack (asset_pack.h).
+//
+//   AssetPackHeader
+//   AssetPackEntry[entryCount]           at tableOffset, sorted by name
+//   entry data                           each at an offset that is a multiple of alignment
+//
+// All values are little-endian. The data of every entry starts on its own page, so a mapped entry
+// can be handed to GL (or copied into a mapped buffer) without realigning it and without touching
+// the pages of its neighbours; the padding is zeros. Every entry carries a hash of its contents.
+
+const char ASSET_PACK_MAGIC[4] = { 'A', 'P', 'A', 'K' };
+const uint32_t ASSET_PACK_VERSION = 1;
+const uint32_t ASSET_PACK_ALIGNMENT = 4096;
+const size_t ASSET_PACK_NAME_SIZE = 56;
+
+struct AssetPackHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t alignment;
+    uint64_t tableOffset;
+    uint64_t fileSize;
+};
+
+struct AssetPackEntry
+{
+    char name[ASSET_PACK_NAME_SIZE];    // the loose file's path, zero-terminated
+    uint64_t offset;
+    uint64_t size;
+    uint64_t hash;                      // assetPackHash of the data
+};
+
+static_assert(sizeof(AssetPackHeader) == 32, "AssetPackHeader must stay tightly packed");
+static_assert(sizeof(AssetPackEntry) == 80, "AssetPackEntry must stay tightly packed");
+
+// 64-bit FNV-1a
+inline uint64_t assetPackHash(const char* data, size_t size)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+#endif
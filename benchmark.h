@@ -0,0 +1,431 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "frame_arena.h"
+#include "gpu_memory.h"
+
+// Measures GPU time per frame with GL_TIME_ELAPSED queries. Results are read back a few
+// frames late from a small ring of query objects, so measuring never stalls the pipeline.
+class GpuTimer
+{
+public:
+    static const int RING_SIZE = 4;
+
+    void create()
+    {
+        glGenQueries(RING_SIZE, queries);
+    }
+
+    void begin()
+    {
+        // the ring is full: the oldest query has to finish before its object can be reused
+        if (frame - collected >= RING_SIZE)
+            readOldest(ready);
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame % RING_SIZE]);
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        frame++;
+    }
+
+    // appends every finished measurement (in milliseconds) to out; with wait set, blocks until all are in
+    void collect(std::vector<double>& out, bool wait = false)
+    {
+        out.insert(out.end(), ready.begin(), ready.end());
+        ready.clear();
+        while (collected < frame)
+        {
+            if (!wait)
+            {
+                GLint available = 0;
+                glGetQueryObjectiv(queries[collected % RING_SIZE], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    break;
+            }
+            readOldest(out);
+        }
+    }
+
+    void destroy()
+    {
+        glDeleteQueries(RING_SIZE, queries);
+    }
+
+private:
+    GLuint queries[RING_SIZE] = {};
+    unsigned long long frame = 0;
+    unsigned long long collected = 0;
+    std::vector<double> ready;
+
+    void readOldest(std::vector<double>& out)
+    {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[collected % RING_SIZE], GL_QUERY_RESULT, &ns);
+        collected++;
+        out.push_back(ns / 1.0e6);
+    }
+};
+
+// Collects per-frame timings of a benchmark run and reports them as JSON.
+class FrameStats
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    std::vector<double> cpuMs;      // time spent on the CPU building and submitting a frame
+    std::vector<double> frameMs;    // interval between consecutive frame starts
+    std::vector<double> gpuMs;
+    std::vector<double> simulateMs; // the frame's job graph, from launch until its last job finished
+    std::vector<double> submitMs;   // the GL thread issuing the previous frame's commands meanwhile
+    unsigned int jobThreads = 1;
+    std::vector<double> resolutionScale;    // of the main pass's width and height, 1 without dynamic resolution
+    std::string submission = "cpu";         // main pass: cpu (CPU culling, render queue) or gpu (compute culling, multi-draw indirect)
+    double resolutionTargetMs = 0.0;        // the frame time dynamic resolution aims for, 0 if off
+    std::vector<double> inputLatencyMs;     // input sampled until the GPU finished the frame and its swap
+    std::vector<double> fenceWaitMs;        // before the frame started, for a frame in flight to finish
+    std::vector<double> limiterWaitMs;      // and for the frame limiter
+    std::string pacingMode;
+    int swapInterval = 0;
+    double fpsLimit = 0.0;
+    int framesInFlight = 0;
+    bool lateInput = false;                 // frames built right after sampling their input
+    std::vector<unsigned int> drawCalls;
+    std::vector<unsigned int> stateChangesIssued;   // binds and uniform writes that reached GL
+    std::vector<unsigned int> stateChangesSkipped;  // dropped by the state cache as redundant
+    std::vector<unsigned int> visibleObjects;   // drawn objects that passed culling
+    std::vector<unsigned int> culledObjects;     // outside the view frustum
+    std::vector<unsigned int> occludedObjects;   // inside it, but hidden behind the occluders
+    std::vector<double> occlusionMs;            // rasterizing the occluders and testing against them
+    std::vector<unsigned int> clusterLights;    // light references in all light clusters together
+    std::vector<double> lightBinningMs;         // moving the point lights and binning them into clusters
+    unsigned int pointLights = 0;
+    std::vector<double> shadowCpuMs;            // deciding and issuing the shadow map updates
+    std::vector<double> shadowGpuMs;            // rendering them
+    std::vector<unsigned int> shadowFacesRendered;      // from scratch
+    std::vector<unsigned int> shadowFacesComposited;    // static copy plus dynamic casters
+    std::vector<unsigned int> shadowDrawCalls;
+    unsigned int shadowStaticFaces = 0;                 // rendered into the static cache
+    std::string shadowMode;
+    double totalMs = 0.0;
+    double timeToFirstFrameMs = 0.0;    // from process start until the first frame has finished on the GPU
+    double texturesReadyMs = -1.0;      // from process start until every texture is streamed in, -1 if never
+    double shaderSetupMs = 0.0;         // building every program, from source or from the program cache
+    unsigned int programCacheHits = 0;
+    unsigned int programCacheMisses = 0;
+    unsigned int shaderVariants = 0;
+    unsigned int sceneNodes = 0;
+    unsigned int stressObjects = 0;     // generated on top of the hand-written scene
+    double peakResidentMb = 0.0;        // the process's peak resident set size
+    double gpuBuffersMb = 0.0;          // GPU heap, frame ring and light buffers at their largest
+    GpuMemoryStats gpuMemory;           // the heap meshes and instances are allocated from, at the end of the run
+    bool gpuMemoryImmutable = false;    // created with glBufferStorage
+    size_t ringRegionBytes = 0;         // per frame
+    size_t ringPeakBytes = 0;
+    unsigned int ringWaits = 0;
+    unsigned int ringOverflows = 0;
+    unsigned int ringResizes = 0;
+    size_t frameArenaCapacity = 0;      // per job system thread
+    size_t frameArenaHighWater = 0;     // all threads together, in the fullest frame
+    std::vector<size_t> frameArenaThreadHighWater;
+    unsigned int frameArenaOverflows = 0;
+    unsigned int frameArenaResizes = 0;
+    std::vector<unsigned long long> heapAllocations;    // operator new calls per frame, COUNT_ALLOCATIONS builds only
+
+    // room for the per-frame series of a run of this many frames, so recording them allocates nothing
+    void reserve(size_t frames)
+    {
+        for (std::vector<double>* series : { &cpuMs, &frameMs, &gpuMs, &simulateMs, &submitMs, &resolutionScale, &occlusionMs,
+                                             &lightBinningMs, &shadowCpuMs, &shadowGpuMs,
+                                             &inputLatencyMs, &fenceWaitMs, &limiterWaitMs })
+            series->reserve(frames);
+        for (std::vector<unsigned int>* series : { &drawCalls, &stateChangesIssued, &stateChangesSkipped, &visibleObjects, &culledObjects,
+                                                   &occludedObjects, &clusterLights, &shadowFacesRendered, &shadowFacesComposited, &shadowDrawCalls })
+            series->reserve(frames);
+        heapAllocations.reserve(frames);
+    }
+
+    void addFrame(double cpu, unsigned int draws)
+    {
+        cpuMs.push_back(cpu);
+        drawCalls.push_back(draws);
+    }
+
+    void addStateChanges(unsigned int issued, unsigned int skipped)
+    {
+        stateChangesIssued.push_back(issued);
+        stateChangesSkipped.push_back(skipped);
+    }
+
+    void addJobs(double simulate, double submit)
+    {
+        simulateMs.push_back(simulate);
+        submitMs.push_back(submit);
+    }
+
+    void addPacing(double fenceWait, double limiterWait)
+    {
+        fenceWaitMs.push_back(fenceWait);
+        limiterWaitMs.push_back(limiterWait);
+    }
+
+    void setPacing(const std::string& mode, int interval, double limit, int inFlight, bool late)
+    {
+        pacingMode = mode;
+        swapInterval = interval;
+        fpsLimit = limit;
+        framesInFlight = inFlight;
+        lateInput = late;
+    }
+
+    void addCulling(unsigned int visible, unsigned int culled, unsigned int occluded, double occlusion)
+    {
+        visibleObjects.push_back(visible);
+        culledObjects.push_back(culled);
+        occludedObjects.push_back(occluded);
+        occlusionMs.push_back(occlusion);
+    }
+
+    void addShadows(unsigned int rendered, unsigned int composited, unsigned int staticFaces, unsigned int draws, double cpu)
+    {
+        shadowFacesRendered.push_back(rendered);
+        shadowFacesComposited.push_back(composited);
+        shadowStaticFaces += staticFaces;
+        shadowDrawCalls.push_back(draws);
+        shadowCpuMs.push_back(cpu);
+    }
+
+    void addLighting(unsigned int lightReferences, double binning)
+    {
+        clusterLights.push_back(lightReferences);
+        lightBinningMs.push_back(binning);
+    }
+
+    void setGpuMemory(const GpuMemoryStats& heap, bool immutable, const GpuRingBuffer& ring)
+    {
+        gpuMemory = heap;
+        gpuMemoryImmutable = immutable;
+        ringRegionBytes = ring.RegionSize;
+        ringPeakBytes = ring.PeakUsed;
+        ringWaits = ring.Waits;
+        ringOverflows = ring.Overflows;
+        ringResizes = ring.Resizes;
+    }
+
+    // called for each frame's arena, the report takes the largest of them thread by thread
+    void addFrameArena(const FrameArena& arena)
+    {
+        frameArenaHighWater = std::max(frameArenaHighWater, arena.HighWater);
+        frameArenaThreadHighWater.resize(std::max(frameArenaThreadHighWater.size(), (size_t)arena.threads()), 0);
+        for (int thread = 0; thread < arena.threads(); thread++)
+        {
+            frameArenaCapacity = std::max(frameArenaCapacity, arena.capacity(thread));
+            frameArenaThreadHighWater[thread] = std::max(frameArenaThreadHighWater[thread], arena.highWater(thread));
+        }
+        frameArenaOverflows += arena.Overflows;
+        frameArenaResizes += arena.Resizes;
+    }
+
+    // peak resident set size of the process so far, in megabytes
+    static double peakResidentMegabytes()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters))
+            return 0.0;
+        return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0.0;
+#if defined(__APPLE__)
+        return usage.ru_maxrss / (1024.0 * 1024.0);     // bytes
+#else
+        return usage.ru_maxrss / 1024.0;                // kilobytes
+#endif
+#endif
+    }
+
+    static double milliseconds(Clock::time_point from, Clock::time_point to)
+    {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    // nearest-rank percentile, p in [0, 100]
+    static double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+            return 0.0;
+        std::sort(values.begin(), values.end());
+        size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+        if (rank > 0)
+            rank--;
+        return values[std::min(rank, values.size() - 1)];
+    }
+
+    void writeJson(std::ostream& out, const std::string& renderer, int width, int height, double timestep) const
+    {
+        unsigned long long totalDraws = 0;
+        for (unsigned int d : drawCalls)
+            totalDraws += d;
+
+        out << "{\n";
+        out << "  \"renderer\": \"" << escape(renderer) << "\",\n";
+        out << "  \"width\": " << width << ",\n";
+        out << "  \"height\": " << height << ",\n";
+        out << "  \"timestep\": " << timestep << ",\n";
+        out << "  \"frames\": " << cpuMs.size() << ",\n";
+        out << "  \"total_ms\": " << totalMs << ",\n";
+        out << "  \"time_to_first_frame_ms\": " << timeToFirstFrameMs << ",\n";
+        out << "  \"textures_ready_ms\": ";
+        if (texturesReadyMs < 0.0)
+            out << "null,\n";
+        else
+            out << texturesReadyMs << ",\n";
+        out << "  \"shader_setup_ms\": " << shaderSetupMs << ",\n";
+        out << "  \"program_cache\": { \"hits\": " << programCacheHits << ", \"misses\": " << programCacheMisses << " },\n";
+        out << "  \"shader_variants\": " << shaderVariants << ",\n";
+        writeSeries(out, "cpu_ms", cpuMs);
+        out << ",\n";
+        writeSeries(out, "frame_ms", frameMs);
+        out << ",\n";
+        writeSeries(out, "gpu_ms", gpuMs);
+        out << ",\n";
+        writeSeries(out, "input_latency_ms", inputLatencyMs);
+        out << ",\n";
+        out << "  \"pacing\": { \"mode\": \"" << escape(pacingMode) << "\", \"swap_interval\": " << swapInterval
+            << ", \"fps_limit\": " << fpsLimit << ", \"frames_in_flight\": " << framesInFlight << ", \"late_input\": "
+            << (lateInput ? "true" : "false") << ", \"fence_wait_ms\": " << mean(fenceWaitMs) << ", \"limiter_wait_ms\": "
+            << mean(limiterWaitMs) << " },\n";
+        out << "  \"dynamic_resolution_target_ms\": " << resolutionTargetMs << ",\n";
+        writeSeries(out, "resolution_scale", resolutionScale);
+        out << ",\n";
+        out << "  \"job_threads\": " << jobThreads << ",\n";
+        writeSeries(out, "simulate_ms", simulateMs);
+        out << ",\n";
+        writeSeries(out, "submit_ms", submitMs);
+        out << ",\n";
+        writeSeries(out, "occlusion_ms", occlusionMs);
+        out << ",\n";
+        writeSeries(out, "light_binning_ms", lightBinningMs);
+        out << ",\n";
+        out << "  \"point_lights\": { \"count\": " << pointLights << ", \"cluster_references\": " << mean(clusterLights) << " },\n";
+        writeSeries(out, "shadow_cpu_ms", shadowCpuMs);
+        out << ",\n";
+        writeSeries(out, "shadow_gpu_ms", shadowGpuMs);
+        out << ",\n";
+        out << "  \"shadows\": { \"mode\": \"" << escape(shadowMode) << "\", \"faces_rendered\": " << mean(shadowFacesRendered)
+            << ", \"faces_composited\": " << mean(shadowFacesComposited) << ", \"static_faces_rendered\": " << shadowStaticFaces
+            << ", \"draw_calls\": " << mean(shadowDrawCalls) << " },\n";
+        out << "  \"submission\": \"" << escape(submission) << "\",\n";
+        out << "  \"draw_calls\": { \"total\": " << totalDraws << ", \"per_frame\": "
+            << (drawCalls.empty() ? 0 : drawCalls.back()) << " },\n";
+        out << "  \"state_changes_per_frame\": { \"issued\": " << mean(stateChangesIssued) << ", \"skipped\": " << mean(stateChangesSkipped) << " },\n";
+        out << "  \"scene\": { \"nodes\": " << sceneNodes << ", \"stress_objects\": " << stressObjects << " },\n";
+        out << "  \"memory\": { \"peak_rss_mb\": " << peakResidentMb << ", \"gpu_buffers_mb\": " << gpuBuffersMb << " },\n";
+        out << "  \"gpu_memory\": { \"immutable\": " << (gpuMemoryImmutable ? "true" : "false") << ", \"buffers\": " << gpuMemory.buffers
+            << ", \"allocations\": " << gpuMemory.allocations << ", \"capacity_mb\": " << gpuMemory.capacity / (1024.0 * 1024.0)
+            << ", \"used_mb\": " << gpuMemory.used / (1024.0 * 1024.0) << ", \"largest_free_mb\": " << gpuMemory.largestFree / (1024.0 * 1024.0)
+            << ", \"free_ranges\": " << gpuMemory.freeRanges << ", \"fragmentation\": " << gpuMemory.fragmentation()
+            << ", \"ring_region_kb\": " << ringRegionBytes / 1024.0 << ", \"ring_peak_kb\": " << ringPeakBytes / 1024.0
+            << ", \"ring_waits\": " << ringWaits << ", \"ring_overflows\": " << ringOverflows << ", \"ring_resizes\": " << ringResizes << " },\n";
+        out << "  \"frame_arena\": { \"capacity_kb\": " << frameArenaCapacity / 1024.0 << ", \"high_water_kb\": " << frameArenaHighWater / 1024.0
+            << ", \"thread_high_water_kb\": [";
+        for (size_t i = 0; i < frameArenaThreadHighWater.size(); i++)
+            out << (i > 0 ? ", " : "") << frameArenaThreadHighWater[i] / 1024.0;
+        out << "], \"overflows\": " << frameArenaOverflows << ", \"resizes\": " << frameArenaResizes << " },\n";
+        out << "  \"heap_allocations_per_frame\": ";
+        if (heapAllocations.empty())
+            out << "null,\n";
+        else
+            out << "{ \"mean\": " << mean(heapAllocations) << ", \"max\": " << *std::max_element(heapAllocations.begin(), heapAllocations.end())
+                << ", \"frames_allocating\": " << heapAllocations.size() - std::count(heapAllocations.begin(), heapAllocations.end(), 0ull) << " },\n";
+        out << "  \"objects_per_frame\": { \"visible\": " << mean(visibleObjects) << ", \"culled\": " << mean(culledObjects)
+            << ", \"occluded\": " << mean(occludedObjects) << " }\n";
+        out << "}" << std::endl;
+    }
+
+    // one row per measured frame, first being the index of the first one, so two runs of the same
+    // recorded input can be compared frame by frame; times that are not available are left empty
+    void writeFrameCsv(std::ostream& out, int first) const
+    {
+        out << "frame,cpu_ms,frame_ms,gpu_ms,simulate_ms,submit_ms,shadow_gpu_ms,resolution_scale,input_latency_ms,draw_calls\n";
+        for (size_t i = 0; i < cpuMs.size(); i++)
+        {
+            out << first + (int)i << ',' << cpuMs[i];
+            writeCell(out, frameMs, i);
+            writeCell(out, gpuMs, i);
+            writeCell(out, simulateMs, i);
+            writeCell(out, submitMs, i);
+            writeCell(out, shadowGpuMs, i);
+            writeCell(out, resolutionScale, i);
+            writeCell(out, inputLatencyMs, i);
+            out << ',' << drawCalls[i] << '\n';
+        }
+        out.flush();
+    }
+
+private:
+    template <typename T>
+    static double mean(const std::vector<T>& values)
+    {
+        double sum = 0.0;
+        for (T v : values)
+            sum += v;
+        return values.empty() ? 0.0 : sum / values.size();
+    }
+
+    static void writeSeries(std::ostream& out, const char* name, const std::vector<double>& values)
+    {
+        double mean = 0.0;
+        for (double v : values)
+            mean += v;
+        if (!values.empty())
+            mean /= values.size();
+
+        out << "  \"" << name << "\": { \"mean\": " << mean
+            << ", \"p50\": " << percentile(values, 50.0)
+            << ", \"p95\": " << percentile(values, 95.0)
+            << ", \"p99\": " << percentile(values, 99.0) << " }";
+    }
+
+    static void writeCell(std::ostream& out, const std::vector<double>& values, size_t i)
+    {
+        out << ',';
+        if (i < values.size())
+            out << values[i];
+    }
+
+    static std::string escape(const std::string& s)
+    {
+        std::string r;
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                r += '\\';
+            r += c;
+        }
+        return r;
+    }
+};
+#endif
@@ -17,6 +17,49 @@ enum Camera_Movement {
     RIGHT
 };
 
+// The six planes of a view frustum, each as (normal, distance) with the normal pointing inwards,
+// so a point p is inside when dot(normal, p) + distance >= 0 for all of them
+struct Frustum
+{
+    enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+    glm::vec4 Planes[6];
+
+    // Gribb/Hartmann extraction from a view-projection matrix (GL clip space, -w <= x, y, z <= w)
+    explicit Frustum(const glm::mat4& viewProjection = glm::mat4(1.0f))
+    {
+        glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        Planes[0] = row3 + row0;    // left
+        Planes[1] = row3 - row0;    // right
+        Planes[2] = row3 + row1;    // bottom
+        Planes[3] = row3 - row1;    // top
+        Planes[4] = row3 + row2;    // near
+        Planes[5] = row3 - row2;    // far
+        for (int i = 0; i < 6; i++)
+            Planes[i] /= glm::length(glm::vec3(Planes[i]));
+    }
+
+    // classifies an axis-aligned box given by its center and half extents
+    Result test(const glm::vec3& center, const glm::vec3& extent) const
+    {
+        Result result = INSIDE;
+        for (int i = 0; i < 6; i++)
+        {
+            glm::vec3 normal(Planes[i]);
+            float distance = glm::dot(normal, center) + Planes[i].w;
+            float radius = glm::dot(glm::abs(normal), extent);
+            if (distance + radius < 0.0f)
+                return OUTSIDE;
+            if (distance - radius < 0.0f)
+                result = INTERSECTS;
+        }
+        return result;
+    }
+};
+
 // Default camera values
 const float YAW         = -90.0f;
 const float PITCH       =  0.0f;
@@ -68,6 +111,12 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // the view frustum for the given projection matrix, for culling against
+    Frustum GetFrustum(const glm::mat4& projection)
+    {
+        return Frustum(projection * GetViewMatrix());
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
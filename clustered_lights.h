@@ -0,0 +1,322 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "frame_arena.h"
+#include "gl_state_cache.h"
+#include "job_system.h"
+
+// A point light with a finite range; its contribution fades to zero at Radius
+struct PointLight
+{
+    glm::vec3 Position;
+    float Radius;
+    glm::vec3 Color;
+};
+
+// One frame's binned lights as they go into the texture buffers
+struct ClusterLists
+{
+    unsigned int LightCount = 0;
+    unsigned int IndexCount = 0;        // light references
+    FrameVector<glm::vec4> packed;      // lightData
+    FrameVector<uint32_t> grid;         // lightGrid
+    FrameVector<uint32_t> indices;      // lightIndices
+};
+
+// Clustered forward shading. The view frustum is split into GRID_X x GRID_Y screen tiles and GRID_Z
+// depth slices (exponentially spaced, so clusters stay roughly cubic); every frame the lights are
+// binned into the clusters their sphere touches and the lists go to the GPU as texture buffers,
+// where the fragment shader finds its cluster from gl_FragCoord and its view depth:
+//
+//   lightData     RGBA32F, two texels per light: position (world space) and radius, color
+//   lightGrid     RG32UI, per cluster: first entry in lightIndices and light count
+//   lightIndices  R32UI, the light lists of all clusters back to back
+//
+// Clusters are indexed (slice * GRID_Y + tileY) * GRID_X + tileX. Binning runs on a JobSystem,
+// first over chunks of lights (view-space bounds), then over depth slices, and writes into a
+// ClusterLists the GL thread uploads later, so a frame can be binned while the last one is drawn.
+class ClusteredLights
+{
+public:
+    enum { GRID_X = 16, GRID_Y = 9, GRID_Z = 24, CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z, LIGHT_CHUNK = 256 };
+
+    void create()
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        for (int i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // computes the view-space bounds of every cluster; call again whenever the projection changes
+    void setProjection(const glm::mat4& projection, float nearPlane, float farPlane)
+    {
+        zNear = nearPlane;
+        zFar = farPlane;
+        sliceScale = GRID_Z / std::log(farPlane / nearPlane);
+        sliceBias = -std::log(nearPlane) * sliceScale;
+        this->projection = projection;
+
+        // view-space rays through the tile corners, scaled to unit depth
+        glm::mat4 inverse = glm::inverse(projection);
+        std::vector<glm::vec3> rays((GRID_X + 1) * (GRID_Y + 1));
+        for (int y = 0; y <= GRID_Y; y++)
+            for (int x = 0; x <= GRID_X; x++)
+            {
+                glm::vec4 point = inverse * glm::vec4(2.0f * x / GRID_X - 1.0f, 2.0f * y / GRID_Y - 1.0f, -1.0f, 1.0f);
+                glm::vec3 ray = glm::vec3(point) / point.w;
+                rays[y * (GRID_X + 1) + x] = ray / -ray.z;
+            }
+
+        clusterMin.resize(CLUSTER_COUNT);
+        clusterMax.resize(CLUSTER_COUNT);
+        for (int z = 0; z < GRID_Z; z++)
+        {
+            float depths[2] = { sliceDepth(z), sliceDepth(z + 1) };
+            for (int y = 0; y < GRID_Y; y++)
+                for (int x = 0; x < GRID_X; x++)
+                {
+                    glm::vec3 low(1e30f), high(-1e30f);
+                    for (int corner = 0; corner < 8; corner++)
+                    {
+                        glm::vec3 point = rays[(y + (corner >> 1 & 1)) * (GRID_X + 1) + x + (corner & 1)] * depths[corner >> 2];
+                        low = glm::min(low, point);
+                        high = glm::max(high, point);
+                    }
+                    int cluster = (z * GRID_Y + y) * GRID_X + x;
+                    clusterMin[cluster] = low;
+                    clusterMax[cluster] = high;
+                }
+        }
+    }
+
+    // bins the lights as seen through view into lists; jobs may be null
+    void update(const std::vector<PointLight>& lights, const glm::mat4& view, JobSystem* jobs, ClusterLists& lists)
+    {
+        lists.LightCount = (unsigned int)lights.size();
+        bounds.resize(lights.size());
+        // the slices' lists only live until they are copied into lists, in its arena if it has one
+        FrameArena* arena = lists.indices.get_allocator().arena;
+        if (arena != NULL)
+            for (Slice& s : slices)
+            {
+                resetFrameVector(s.indices, *arena);
+                resetFrameVector(s.pairs, *arena);
+            }
+        int lightChunks = ((int)lights.size() + LIGHT_CHUNK - 1) / LIGHT_CHUNK;
+        auto boundLights = [this, &lights, &view](int chunk) {
+            int end = std::min((int)lights.size(), (chunk + 1) * LIGHT_CHUNK);
+            for (int i = chunk * LIGHT_CHUNK; i < end; i++)
+                bounds[i] = lightBounds(lights[i], view);
+        };
+        auto binSlice = [this](int slice) { bin(slice); };
+        if (jobs != NULL)
+        {
+            jobs->parallelFor(lightChunks, boundLights);
+            jobs->parallelFor(GRID_Z, binSlice);
+        }
+        else
+        {
+            for (int chunk = 0; chunk < lightChunks; chunk++)
+                boundLights(chunk);
+            for (int slice = 0; slice < GRID_Z; slice++)
+                binSlice(slice);
+        }
+
+        // the slices' lists back to back, offsets made global
+        FrameVector<uint32_t>& grid = lists.grid;
+        FrameVector<uint32_t>& indices = lists.indices;
+        lists.IndexCount = 0;
+        for (int slice = 0; slice < GRID_Z; slice++)
+            lists.IndexCount += (unsigned int)slices[slice].indices.size();
+        grid.resize(2 * CLUSTER_COUNT);
+        indices.resize(std::max(1u, lists.IndexCount));
+        unsigned int offset = 0;
+        for (int slice = 0; slice < GRID_Z; slice++)
+        {
+            const Slice& s = slices[slice];
+            for (int i = 0; i < GRID_X * GRID_Y; i++)
+            {
+                int cluster = slice * GRID_X * GRID_Y + i;
+                grid[2 * cluster] = offset + s.offsets[i];
+                grid[2 * cluster + 1] = s.offsets[i + 1] - s.offsets[i];
+            }
+            std::copy(s.indices.begin(), s.indices.end(), indices.begin() + offset);
+            offset += (unsigned int)s.indices.size();
+        }
+
+        lists.packed.resize(std::max<size_t>(1, lights.size()) * 2);
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            lists.packed[2 * i] = glm::vec4(lights[i].Position, lights[i].Radius);
+            lists.packed[2 * i + 1] = glm::vec4(lights[i].Color, 0.0f);
+        }
+    }
+
+    // replaces the texture buffers' contents with lists from update()
+    void upload(const ClusterLists& lists)
+    {
+        upload(buffers[0], lists.packed.data(), lists.packed.size() * sizeof(glm::vec4));
+        upload(buffers[1], lists.grid.data(), lists.grid.size() * sizeof(uint32_t));
+        upload(buffers[2], lists.indices.data(), lists.indices.size() * sizeof(uint32_t));
+    }
+
+    // binds lightData, lightGrid and lightIndices to the texture units firstUnit .. firstUnit + 2
+    void bind(unsigned int firstUnit, GLStateCache& state) const
+    {
+        for (int i = 0; i < 3; i++)
+            state.bindTexture(firstUnit + i, GL_TEXTURE_BUFFER, textures[i]);
+    }
+
+    // the shader's cluster lookup: pixels per tile and grid size, then slice = log(depth) * x + y
+    glm::vec4 tileParameters(int viewportWidth, int viewportHeight) const
+    {
+        return glm::vec4((float)viewportWidth / GRID_X, (float)viewportHeight / GRID_Y, GRID_X, GRID_Y);
+    }
+
+    glm::vec4 sliceParameters(const ClusterLists& lists) const
+    {
+        return glm::vec4(sliceScale, sliceBias, GRID_Z, (float)lists.LightCount);
+    }
+
+    void destroy()
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+private:
+    // the clusters a light may touch; an empty slice range if it is entirely outside the depth range
+    struct LightBounds
+    {
+        glm::vec3 center;       // view space
+        float radius;
+        int minSlice, maxSlice;
+        int minX, maxX, minY, maxY;
+    };
+
+    // one depth slice's lists: cluster i of the slice owns indices[offsets[i] .. offsets[i + 1])
+    struct Slice
+    {
+        std::vector<uint32_t> offsets;
+        FrameVector<uint32_t> indices;
+        FrameVector<uint64_t> pairs;    // cluster in slice << 32 | light, before sorting by cluster
+        std::vector<uint32_t> cursors;
+    };
+
+    unsigned int buffers[3] = {};
+    unsigned int textures[3] = {};
+    glm::mat4 projection;
+    float zNear = 0.1f, zFar = 100.0f;
+    float sliceScale = 0.0f, sliceBias = 0.0f;
+    std::vector<glm::vec3> clusterMin, clusterMax;
+
+    std::vector<LightBounds> bounds;
+    Slice slices[GRID_Z];
+
+    float sliceDepth(int slice) const
+    {
+        return zNear * std::pow(zFar / zNear, (float)slice / GRID_Z);
+    }
+
+    int sliceOf(float depth) const
+    {
+        return std::min(GRID_Z - 1, std::max(0, (int)std::floor(std::log(depth) * sliceScale + sliceBias)));
+    }
+
+    LightBounds lightBounds(const PointLight& light, const glm::mat4& view) const
+    {
+        LightBounds b;
+        b.center = glm::vec3(view * glm::vec4(light.Position, 1.0f));
+        b.radius = light.Radius;
+        float nearest = -b.center.z - b.radius, farthest = -b.center.z + b.radius;
+        if (farthest < zNear || nearest > zFar)
+        {
+            b.minSlice = 0;
+            b.maxSlice = -1;
+            return b;
+        }
+        b.minSlice = sliceOf(std::max(nearest, zNear));
+        b.maxSlice = sliceOf(std::min(farthest, zFar));
+
+        b.minX = 0, b.maxX = GRID_X - 1, b.minY = 0, b.maxY = GRID_Y - 1;
+        if (nearest > zNear)
+        {
+            // the projected corners of the sphere's box bound its screen footprint
+            glm::vec2 low(1e30f), high(-1e30f);
+            for (int corner = 0; corner < 8; corner++)
+            {
+                glm::vec3 offset(corner & 1 ? b.radius : -b.radius, corner & 2 ? b.radius : -b.radius, corner & 4 ? b.radius : -b.radius);
+                glm::vec4 clip = projection * glm::vec4(b.center + offset, 1.0f);
+                glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                low = glm::min(low, ndc);
+                high = glm::max(high, ndc);
+            }
+            b.minX = std::max(0, (int)std::floor((low.x * 0.5f + 0.5f) * GRID_X));
+            b.maxX = std::min(GRID_X - 1, (int)std::floor((high.x * 0.5f + 0.5f) * GRID_X));
+            b.minY = std::max(0, (int)std::floor((low.y * 0.5f + 0.5f) * GRID_Y));
+            b.maxY = std::min(GRID_Y - 1, (int)std::floor((high.y * 0.5f + 0.5f) * GRID_Y));
+        }
+        return b;
+    }
+
+    // builds one slice's lists: every light whose sphere touches a cluster's box, in light order
+    void bin(int slice)
+    {
+        Slice& s = slices[slice];
+        s.pairs.clear();
+        for (size_t light = 0; light < bounds.size(); light++)
+        {
+            const LightBounds& b = bounds[light];
+            if (slice < b.minSlice || slice > b.maxSlice)
+                continue;
+            for (int y = b.minY; y <= b.maxY; y++)
+                for (int x = b.minX; x <= b.maxX; x++)
+                {
+                    int local = y * GRID_X + x;
+                    int cluster = slice * GRID_X * GRID_Y + local;
+                    glm::vec3 closest = glm::clamp(b.center, clusterMin[cluster], clusterMax[cluster]);
+                    glm::vec3 d = closest - b.center;
+                    if (glm::dot(d, d) <= b.radius * b.radius)
+                        s.pairs.push_back((uint64_t)local << 32 | (uint64_t)light);
+                }
+        }
+
+        // counting sort by cluster; stable, so every list keeps the light order
+        s.offsets.assign(GRID_X * GRID_Y + 1, 0);
+        for (uint64_t pair : s.pairs)
+            s.offsets[(pair >> 32) + 1]++;
+        for (int i = 0; i < GRID_X * GRID_Y; i++)
+            s.offsets[i + 1] += s.offsets[i];
+        s.indices.resize(s.pairs.size());
+        s.cursors.assign(s.offsets.begin(), s.offsets.end() - 1);
+        for (uint64_t pair : s.pairs)
+            s.indices[s.cursors[pair >> 32]++] = (uint32_t)pair;
+    }
+
+    // replaces a buffer's contents, orphaning the storage the GPU may still read
+    static void upload(unsigned int buffer, const void* data, size_t size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+#endif
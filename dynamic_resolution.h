@@ -0,0 +1,118 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// The render target of dynamic resolution: color and depth at the output size, of which each frame
+// only uses the lower left corner at its render size, so changing the resolution never reallocates
+// anything. upscale() stretches that corner over the output with bilinear filtering.
+class ScaledTarget
+{
+public:
+    unsigned int FBO = 0;
+    unsigned int colorTexture = 0;
+    unsigned int depthRBO = 0;
+    int Width = 0;      // the output size, the largest render size
+    int Height = 0;
+
+    bool create(int width, int height)
+    {
+        Width = width;
+        Height = height;
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+        glGenTextures(1, &colorTexture);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "ERROR::FRAMEBUFFER:: Scaled framebuffer is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return complete;
+    }
+
+    // binds the target with the viewport (and scissor, so clears stay inside it) at the render size
+    void bind(int renderWidth, int renderHeight)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, renderWidth, renderHeight);
+        glScissor(0, 0, renderWidth, renderHeight);
+        glEnable(GL_SCISSOR_TEST);
+    }
+
+    // draws the rendered corner over the whole of framebuffer, outputWidth x outputHeight, and leaves
+    // that framebuffer bound
+    void upscale(unsigned int framebuffer, int renderWidth, int renderHeight, int outputWidth, int outputHeight)
+    {
+        glDisable(GL_SCISSOR_TEST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, outputWidth, outputHeight, GL_COLOR_BUFFER_BIT,
+                          renderWidth == outputWidth && renderHeight == outputHeight ? GL_NEAREST : GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, outputWidth, outputHeight);
+    }
+
+    void destroy()
+    {
+        glDeleteTextures(1, &colorTexture);
+        glDeleteRenderbuffers(1, &depthRBO);
+        glDeleteFramebuffers(1, &FBO);
+        FBO = colorTexture = depthRBO = 0;
+    }
+};
+
+// Picks the render scale (of width and height) that keeps the frame time at a target. The frame
+// time is smoothed first, and since the cost of the pixel work grows with the pixel count, the
+// scale the target would need is the current one times sqrt(target / smoothed); the controller
+// moves halfway there per update and ignores changes of less than Deadband, so the resolution
+// settles instead of hunting.
+class ResolutionController
+{
+public:
+    double TargetMs = 16.667;
+    float MinScale = 0.5f;
+    float MaxScale = 1.0f;
+    float Deadband = 0.02f;
+    float Scale = 1.0f;
+
+    // takes the time of the last finished frame and returns the scale for the next one
+    float update(double frameMs)
+    {
+        smoothedMs = smoothedMs > 0.0 ? smoothedMs + 0.25 * (frameMs - smoothedMs) : frameMs;
+        float wanted = Scale * (float)std::sqrt(TargetMs / std::max(smoothedMs, 0.001));
+        float next = std::min(MaxScale, std::max(MinScale, Scale + 0.5f * (wanted - Scale)));
+        if (std::fabs(next - Scale) >= Deadband || next == MinScale || next == MaxScale)
+            Scale = next;
+        return Scale;
+    }
+
+    // a multiple of 8 pixels, so the resolution moves in steps instead of every frame
+    static int renderSize(int outputSize, float scale)
+    {
+        int size = (int)std::lround(outputSize * scale / 8.0) * 8;
+        return std::min(outputSize, std::max(8, size));
+    }
+
+private:
+    double smoothedMs = 0.0;
+};
+#endif
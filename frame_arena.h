@@ -0,0 +1,187 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "job_system.h"
+
+// Memory for the data one frame builds and throws away: render queue items, instance and object
+// uploads, light lists, shadow caster bounds. Allocating is bumping an offset, freeing does nothing,
+// and reset() drops everything at once when the frame's slot is reused.
+//
+// Every job system thread bumps its own sub-arena (picked by JobSystem::threadIndex()), so workers
+// never contend; threads outside the system must not allocate. A sub-arena that runs out reports it
+// once, the frame carries on from the heap and the sub-arena is grown to what that frame needed at
+// the next reset(), like GpuRingBuffer's regions.
+class FrameArena
+{
+public:
+    size_t HighWater = 0;           // the most all sub-arenas together held in one frame
+    unsigned int Overflows = 0;     // frames a sub-arena ran out in
+    unsigned int Resizes = 0;
+
+    // one sub-arena of capacity bytes per job system thread (threads counts the GL thread)
+    void create(int threads, size_t capacity)
+    {
+        blocks.clear();
+        for (int i = 0; i < threads; i++)
+        {
+            blocks.emplace_back(new Block());
+            blocks.back()->resize(capacity);
+        }
+        HighWater = 0;
+        Overflows = Resizes = 0;
+    }
+
+    void* allocate(size_t size, size_t alignment)
+    {
+        Block& block = *blocks[JobSystem::threadIndex()];
+        size_t offset = (block.used + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= block.capacity)
+        {
+            block.used = offset + size;
+            return block.memory.get() + offset;
+        }
+        if (block.spilled.empty())
+            std::cout << "ERROR::FRAME_ARENA::OVERFLOW: " << block.capacity / 1024 << " KB per thread is too small" << std::endl;
+        block.needed = std::max(block.needed, offset + size);
+        block.spilled.push_back(::operator new(size));
+        return block.spilled.back();
+    }
+
+    // starts a frame: the memory of the last one using this arena is handed out again
+    void reset()
+    {
+        size_t used = 0;
+        for (std::unique_ptr<Block>& block : blocks)
+        {
+            used += std::max(block->used, block->needed);
+            block->highWater = std::max(block->highWater, std::max(block->used, block->needed));
+            if (!block->spilled.empty())
+            {
+                for (void* memory : block->spilled)
+                    ::operator delete(memory);
+                block->spilled.clear();
+                size_t capacity = block->capacity;
+                while (capacity < block->needed)
+                    capacity *= 2;
+                block->resize(capacity);
+                Overflows++;
+                Resizes++;
+            }
+            block->used = 0;
+            block->needed = 0;
+        }
+        HighWater = std::max(HighWater, used);
+    }
+
+    int threads() const
+    {
+        return (int)blocks.size();
+    }
+
+    // of one sub-arena
+    size_t capacity(int thread) const
+    {
+        return blocks[thread]->capacity;
+    }
+
+    size_t highWater(int thread) const
+    {
+        return blocks[thread]->highWater;
+    }
+
+private:
+    // a thread's sub-arena; the padding keeps the next one allocated after it off its cache lines
+    // (padding instead of alignas(64), which plain new only honours from C++17 on)
+    struct Block
+    {
+        std::unique_ptr<unsigned char[]> memory;
+        size_t capacity = 0;
+        size_t used = 0;
+        size_t needed = 0;          // what the frame would have taken, when it spilled
+        size_t highWater = 0;
+        std::vector<void*> spilled;
+        unsigned char padding[64];
+
+        void resize(size_t bytes)
+        {
+            memory.reset(new unsigned char[bytes]);
+            capacity = bytes;
+        }
+    };
+
+    std::vector<std::unique_ptr<Block> > blocks;
+};
+
+// Lets STL containers allocate from a FrameArena; without one (the default) it is the heap, so the
+// same container types work outside the frame loop. Deallocating arena memory does nothing, and a
+// container takes the arena along when it is moved, which is how resetFrameVector() points a list at
+// the next frame's arena.
+template <typename T>
+class FrameAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    FrameArena* arena;
+
+    FrameAllocator(FrameArena* arena = NULL) : arena(arena) {}
+
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count)
+    {
+        if (arena == NULL)
+            return static_cast<T*>(::operator new(count * sizeof(T)));
+        return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* pointer, size_t)
+    {
+        if (arena == NULL)
+            ::operator delete(pointer);
+    }
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U>& other) const
+    {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const FrameAllocator<U>& other) const
+    {
+        return arena != other.arena;
+    }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T> >;
+
+// empties a list into arena; what it held is dropped with the arena's last frame, not freed
+template <typename T>
+void resetFrameVector(FrameVector<T>& list, FrameArena& arena)
+{
+    list = FrameVector<T>(FrameAllocator<T>(&arena));
+}
+
+// Counts operator new calls when the build defines COUNT_ALLOCATIONS (Main.cpp replaces the global
+// operator new then), to check that the frame loop does not touch the heap
+inline std::atomic<unsigned long long>& heapAllocations()
+{
+    static std::atomic<unsigned long long> count{ 0 };
+    return count;
+}
+#endif
@@ -0,0 +1,222 @@
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+
+// How frames are paced
+enum PacingMode
+{
+    PACING_VSYNC,       // swap interval 1: presents wait for the display's refresh
+    PACING_ADAPTIVE,    // swap interval -1: like vsync, but a late frame is presented at once (tearing)
+    PACING_UNCAPPED,    // swap interval 0: as fast as the frames are done
+    PACING_LIMIT,       // swap interval 0, started at a fixed rate by the frame limiter
+};
+
+const char* const PACING_MODE_NAMES[] = { "vsync", "adaptive", "uncapped", "limit" };
+const int PACING_MODE_COUNT = sizeof PACING_MODE_NAMES / sizeof PACING_MODE_NAMES[0];
+
+inline bool parsePacingMode(const char* name, PacingMode& mode)
+{
+    for (int i = 0; i < PACING_MODE_COUNT; i++)
+        if (strcmp(name, PACING_MODE_NAMES[i]) == 0)
+        {
+            mode = (PacingMode)i;
+            return true;
+        }
+    return false;
+}
+
+// Decides when the next frame starts. beginFrame() runs before the frame samples its input and
+// waits for two things: for a fence, until no more than FramesInFlight frames are queued on the GPU
+// (so the driver cannot buffer up frames whose input gets older while they wait), and in
+// PACING_LIMIT mode for the limiter's next deadline. The limiter sleeps while the deadline is further
+// away than the longest oversleep it has seen and spins for the rest, which holds the rate to well
+// under a millisecond without burning a core for the whole frame.
+//
+// endFrame() goes right after the swap. It takes the time the frame's input was sampled and puts a
+// GPU timestamp behind the swap; once the frame's fence has passed, the timestamp is translated to
+// the CPU clock and input-to-present latency (sampled input until the GPU finished the frame, its
+// swap included; scanout can come up to a refresh later with vsync) is ready for collect().
+class FramePacer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    static const int MAX_FRAMES_IN_FLIGHT = 4;
+
+    PacingMode Mode = PACING_VSYNC;
+    int SwapInterval = 0;           // set on the window; -1 is adaptive
+    double FpsLimit = 0.0;          // PACING_LIMIT only
+    int FramesInFlight = 2;
+    double FenceWaitMs = 0.0;       // the last beginFrame()'s waits
+    double LimiterWaitMs = 0.0;
+    double LatencyMs = 0.0;         // input to present of the last frame that finished, measured or not
+
+    // window is the current context's window, nullptr when there is no swap chain to set an interval on
+    void create(PacingMode mode, double fpsLimit, int framesInFlight, GLFWwindow* window)
+    {
+        Mode = mode;
+        FpsLimit = mode == PACING_LIMIT ? fpsLimit : 0.0;
+        FramesInFlight = std::max(1, std::min(framesInFlight, (int)MAX_FRAMES_IN_FLIGHT));
+        period = FpsLimit > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / FpsLimit)) : Clock::duration::zero();
+        spinMargin = std::chrono::microseconds(MIN_SPIN_US);
+        deadline = Clock::time_point();
+        glGenQueries(MAX_FRAMES_IN_FLIGHT, queries);
+        ready.reserve(MAX_FRAMES_IN_FLIGHT);
+        calibrate();
+
+        SwapInterval = mode == PACING_VSYNC ? 1 : mode == PACING_ADAPTIVE ? -1 : 0;
+        if (SwapInterval < 0 && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+        {
+            std::cout << "ERROR::FRAME_PACING::ADAPTIVE_NOT_SUPPORTED: needs EXT_swap_control_tear, using vsync" << std::endl;
+            SwapInterval = 1;
+        }
+        if (window != nullptr)
+            glfwSwapInterval(SwapInterval);
+    }
+
+    // waits until the next frame may start; call it before sampling the frame's input
+    void beginFrame()
+    {
+        PROFILE_ZONE("frame pacing");
+        Clock::time_point start = Clock::now();
+        waitForFrame((long long)frame - FramesInFlight);
+        Clock::time_point fenced = Clock::now();
+        if (Mode == PACING_LIMIT)
+        {
+            // a frame that started late moves the deadlines instead of being caught up with a burst
+            deadline += period;
+            if (deadline < fenced - period)
+                deadline = fenced;
+            waitUntil(deadline);
+        }
+        FenceWaitMs = std::chrono::duration<double, std::milli>(fenced - start).count();
+        LimiterWaitMs = std::chrono::duration<double, std::milli>(Clock::now() - fenced).count();
+    }
+
+    // after the swap; inputTime is when the frame presented took its input, measured whether its
+    // latency is reported
+    void endFrame(Clock::time_point inputTime, bool measured)
+    {
+        Slot& slot = slots[frame % MAX_FRAMES_IN_FLIGHT];
+        glQueryCounter(queries[frame % MAX_FRAMES_IN_FLIGHT], GL_TIMESTAMP);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.inputTime = inputTime;
+        slot.measured = measured;
+        frame++;
+        if (frame % CALIBRATION_INTERVAL == 0)
+            calibrate();
+    }
+
+    // appends the latencies (in milliseconds) of measured frames that have finished; with wait set,
+    // waits for all of them
+    void collect(std::vector<double>& out, bool wait = false)
+    {
+        if (wait)
+            for (unsigned long long i = std::max(frame, (unsigned long long)MAX_FRAMES_IN_FLIGHT) - MAX_FRAMES_IN_FLIGHT; i < frame; i++)
+                waitForFrame((long long)i);
+        out.insert(out.end(), ready.begin(), ready.end());
+        ready.clear();
+    }
+
+    void destroy()
+    {
+        for (Slot& slot : slots)
+            if (slot.fence)
+            {
+                glDeleteSync(slot.fence);
+                slot.fence = 0;
+            }
+        glDeleteQueries(MAX_FRAMES_IN_FLIGHT, queries);
+    }
+
+private:
+    static const int CALIBRATION_INTERVAL = 64;     // frames between re-reading the GPU clock
+
+    // the oversleep the limiter spins for is kept within these
+    static const int MIN_SPIN_US = 500;
+    static const int MAX_SPIN_US = 4000;
+
+    // a frame on its way to the GPU
+    struct Slot
+    {
+        GLsync fence = 0;
+        Clock::time_point inputTime;
+        bool measured = false;
+    };
+
+    Slot slots[MAX_FRAMES_IN_FLIGHT];
+    GLuint queries[MAX_FRAMES_IN_FLIGHT] = {};
+    unsigned long long frame = 0;       // frames ended
+    long long gpuToCpuNs = 0;           // added to a GPU timestamp gives the steady clock's time
+    Clock::duration period = Clock::duration::zero();
+    Clock::duration spinMargin = std::chrono::microseconds(MIN_SPIN_US);
+    Clock::time_point deadline;
+    std::vector<double> ready;
+
+    // blocks until frame index has finished on the GPU and reads its latency; nothing to do for
+    // indices before the first frame or already waited for
+    void waitForFrame(long long index)
+    {
+        if (index < 0)
+            return;
+        Slot& slot = slots[index % MAX_FRAMES_IN_FLIGHT];
+        if (!slot.fence)
+            return;
+        glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+
+        // the fence has passed, so the timestamp written before it is available
+        GLuint64 gpuNs = 0;
+        glGetQueryObjectui64v(queries[index % MAX_FRAMES_IN_FLIGHT], GL_QUERY_RESULT, &gpuNs);
+        long long presentNs = (long long)gpuNs + gpuToCpuNs;
+        long long inputNs = std::chrono::duration_cast<std::chrono::nanoseconds>(slot.inputTime.time_since_epoch()).count();
+        LatencyMs = (presentNs - inputNs) / 1.0e6;
+        if (slot.measured)
+            ready.push_back(LatencyMs);
+    }
+
+    // the offset between the GPU's timestamp clock and the steady clock
+    void calibrate()
+    {
+        GLint64 gpuNs = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNs);
+        long long cpuNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+        gpuToCpuNs = cpuNs - (long long)gpuNs;
+    }
+
+    // sleeps until spinMargin before the deadline, then spins; a sleep that overshoots widens the
+    // margin, which shrinks back slowly while sleeps are accurate
+    void waitUntil(Clock::time_point until)
+    {
+        for (;;)
+        {
+            Clock::time_point now = Clock::now();
+            if (now >= until)
+                return;
+            if (until - now > spinMargin)
+            {
+                Clock::duration sleep = until - now - spinMargin;
+                std::this_thread::sleep_for(sleep);
+                Clock::duration overslept = Clock::now() - now - sleep;
+                spinMargin = std::max(overslept, spinMargin - spinMargin / 64);
+                spinMargin = std::max<Clock::duration>(std::chrono::microseconds(MIN_SPIN_US), std::min<Clock::duration>(spinMargin, std::chrono::microseconds(MAX_SPIN_US)));
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+};
+#endif
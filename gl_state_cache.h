@@ -0,0 +1,138 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+// A shadow copy of the GL state the frame loop changes most: the program, the vertex array, the
+// texture bound to each unit and uniform values per program. Calls that would not change anything
+// are dropped. Issued and Skipped count the calls that went to GL and the ones that did not since
+// the last resetCounters().
+//
+// Everything starts out unknown, so the first call always goes through. Code that changes these
+// bindings directly (setup, VAO configuration) has to call invalidate() before the cache is used again.
+class GLStateCache
+{
+public:
+    enum { MAX_TEXTURE_UNITS = 16 };
+
+    unsigned int Issued = 0;
+    unsigned int Skipped = 0;
+
+    GLStateCache()
+    {
+        invalidate();
+    }
+
+    void invalidate()
+    {
+        program = vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            textures[unit] = Texture{ 0, UNKNOWN };
+        intUniforms.clear();
+        matrixUniforms.clear();
+    }
+
+    void resetCounters()
+    {
+        Issued = Skipped = 0;
+    }
+
+    void useProgram(unsigned int id)
+    {
+        if (changed(program, id))
+            glUseProgram(id);
+    }
+
+    void bindVertexArray(unsigned int vao)
+    {
+        if (changed(vertexArray, vao))
+            glBindVertexArray(vao);
+    }
+
+    void bindTexture(unsigned int unit, GLenum target, unsigned int texture)
+    {
+        Texture& bound = textures[unit];
+        if (bound.target == target && bound.texture == texture)
+        {
+            Skipped++;
+            return;
+        }
+        if (changed(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        Issued++;
+        bound = Texture{ target, texture };
+    }
+
+    // uniforms of the program bound with useProgram()
+    void setInt(GLint location, int value)
+    {
+        if (location < 0)
+            return;
+        std::unordered_map<uint64_t, int>::iterator it = intUniforms.find(uniformKey(location));
+        if (it != intUniforms.end() && it->second == value)
+        {
+            Skipped++;
+            return;
+        }
+        intUniforms[uniformKey(location)] = value;
+        glUniform1i(location, value);
+        Issued++;
+    }
+
+    void setMat4(GLint location, const glm::mat4& value)
+    {
+        if (location < 0)
+            return;
+        std::unordered_map<uint64_t, glm::mat4>::iterator it = matrixUniforms.find(uniformKey(location));
+        if (it != matrixUniforms.end() && std::memcmp(&it->second, &value, sizeof(glm::mat4)) == 0)
+        {
+            Skipped++;
+            return;
+        }
+        matrixUniforms[uniformKey(location)] = value;
+        glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+        Issued++;
+    }
+
+private:
+    static const unsigned int UNKNOWN = 0xFFFFFFFFu;
+
+    struct Texture
+    {
+        GLenum target;
+        unsigned int texture;
+    };
+
+    unsigned int program;
+    unsigned int vertexArray;
+    unsigned int activeUnit;
+    Texture textures[MAX_TEXTURE_UNITS];
+    std::unordered_map<uint64_t, int> intUniforms;          // program << 32 | location
+    std::unordered_map<uint64_t, glm::mat4> matrixUniforms;
+
+    // true (and counted as issued) if the value differs from the cached one, which it then replaces
+    bool changed(unsigned int& cached, unsigned int value)
+    {
+        if (cached == value)
+        {
+            Skipped++;
+            return false;
+        }
+        cached = value;
+        Issued++;
+        return true;
+    }
+
+    uint64_t uniformKey(GLint location) const
+    {
+        return (uint64_t)program << 32 | (uint32_t)location;
+    }
+};
+#endif
@@ -0,0 +1,229 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <learnopenggl/camera.h>
+#include <learnopenggl/shader_m.h>
+
+#include "frame_arena.h"
+#include "gl_state_cache.h"
+#include "gpu_memory.h"
+#include "mesh.h"
+#include "scene_graph.h"
+
+// Compute shaders, shader storage buffers and glMultiDrawElementsIndirect are GL 4.3; gl_DrawID
+// needs GL 4.6 or ARB_shader_draw_parameters on top
+#if defined(GL_VERSION_4_3)
+#define GPU_CULLING_SUPPORTED 1
+#endif
+
+// One object in the object buffer, mirrors ObjectData (std430) in cull.csh and indirect.vsh
+struct GpuObject
+{
+    glm::mat4 model;
+    glm::vec4 normalMatrix[3];
+    glm::vec4 center;           // w: texture array layer
+    glm::vec4 extent;
+};
+
+static_assert(sizeof(GpuObject) == 144, "GpuObject must match the std430 layout of ObjectData");
+
+// glMultiDrawElementsIndirect's record, written by cull.csh
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// The objects that changed in one frame, gathered off the GL thread like an InstanceUpload
+struct GpuObjectUpload
+{
+    int first = 0;
+    FrameVector<GpuObject> objects;
+};
+
+// GPU-driven submission: every drawn object's transform and world bounds live in a shader storage
+// buffer, cull.csh tests the bounds against the view frustum and writes one indirect draw per
+// object (one instance if visible, none if not), and each group of objects sharing a program is
+// drawn with a single glMultiDrawElementsIndirect whose vertex shader (indirect.vsh) fetches its
+// object by gl_DrawID. The CPU neither culls nor issues per-object work, it only uploads what moved.
+//
+// Objects are stored group by group; a program drawing group g sets its firstObject uniform to
+// groupStart(g), since gl_DrawID restarts at 0 with every multi-draw.
+class GpuCuller
+{
+public:
+    enum { OBJECT_BINDING = 0, COMMAND_BINDING = 1, WORKGROUP_SIZE = 64 };
+
+    std::vector<int> Nodes;     // object i is scene node Nodes[i]
+
+    // whether the context has everything the path needs, the vertex stage's storage buffers included
+    static bool supported()
+    {
+#ifdef GPU_CULLING_SUPPORTED
+        GLint major = 0, minor = 0, vertexBlocks = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major < 4 || (major == 4 && minor < 3))
+            return false;
+        glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertexBlocks);
+        if (vertexBlocks < 1)
+            return false;
+        if (major > 4 || minor >= 6)
+            return true;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (name != NULL && strcmp(name, "GL_ARB_shader_draw_parameters") == 0)
+                return true;
+        }
+#endif
+        return false;
+    }
+
+    // stores the groups' nodes back to back and uploads all of them; every object is drawn as mesh
+    void build(const SceneGraph& scene, const std::vector<std::vector<int> >& groups, const Mesh& mesh, GpuHeap& heap)
+    {
+        this->mesh = &mesh;
+        this->heap = &heap;
+        Nodes.clear();
+        groupStarts.clear();
+        for (const std::vector<int>& group : groups)
+        {
+            groupStarts.push_back((int)Nodes.size());
+            Nodes.insert(Nodes.end(), group.begin(), group.end());
+        }
+        groupStarts.push_back((int)Nodes.size());
+        slotOf.assign(scene.size(), -1);
+        for (size_t i = 0; i < Nodes.size(); i++)
+            slotOf[Nodes[i]] = (int)i;
+
+        GLint alignment = 16;
+#ifdef GPU_CULLING_SUPPORTED
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+#endif
+        destroy();
+        objects = heap.allocate(Nodes.size() * sizeof(GpuObject), std::max(alignment, 16));
+        commands = heap.allocate(Nodes.size() * sizeof(DrawElementsIndirectCommand), std::max(alignment, 16));
+
+        GpuObjectUpload all;
+        all.objects.resize(Nodes.size());
+        for (size_t i = 0; i < Nodes.size(); i++)
+            pack(scene, Nodes[i], all.objects[i]);
+        upload(all, NULL);
+    }
+
+    // collects the objects whose matrices the scene's last update() changed, as one range
+    void gather(const SceneGraph& scene, GpuObjectUpload& changes) const
+    {
+        int first = (int)Nodes.size();
+        int last = -1;
+        for (int node : scene.Changed)
+        {
+            int slot = node < (int)slotOf.size() ? slotOf[node] : -1;
+            if (slot < 0)
+                continue;
+            first = std::min(first, slot);
+            last = std::max(last, slot);
+        }
+        changes.first = first;
+        changes.objects.clear();
+        if (last < first)
+            return;
+        changes.objects.resize(last - first + 1);
+        for (int slot = first; slot <= last; slot++)
+            pack(scene, Nodes[slot], changes.objects[slot - first]);
+    }
+
+    void upload(const GpuObjectUpload& changes, GpuRingBuffer* staging)
+    {
+        if (!changes.objects.empty())
+            heap->write(objects, changes.first * sizeof(GpuObject), changes.objects.data(), changes.objects.size() * sizeof(GpuObject), staging);
+    }
+
+    // rewrites every object's draw command for the frustum of viewProjection
+    void cull(GLStateCache& state, const Shader& cullShader, const glm::mat4& viewProjection)
+    {
+#ifdef GPU_CULLING_SUPPORTED
+        if (Nodes.empty())
+            return;
+        Frustum frustum(viewProjection);
+        state.useProgram(cullShader.ID);
+        glUniform4fv(cullShader.getUniformLocation("frustumPlanes"), 6, &frustum.Planes[0][0]);
+        state.setInt(cullShader.getUniformLocation("objectCount"), (int)Nodes.size());
+        state.setInt(cullShader.getUniformLocation("indexCount"), (int)mesh->IndexCount);
+        state.setInt(cullShader.getUniformLocation("firstIndex"), (int)(mesh->Indices.offset / (mesh->IndexType == GL_UNSIGNED_SHORT ? 2 : 4)));
+        bindObjects();
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, commands.buffer, commands.offset, Nodes.size() * sizeof(DrawElementsIndirectCommand));
+        glDispatchCompute((GLuint)((Nodes.size() + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE), 1, 1);
+        // the commands are read as indirect draws, the objects again by the vertex shader
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+#endif
+    }
+
+    // draws a group with the program and the mesh's vertex array bound; returns the draw calls issued
+    unsigned int draw(int group)
+    {
+#ifdef GPU_CULLING_SUPPORTED
+        int count = groupStarts[group + 1] - groupStarts[group];
+        if (count == 0)
+            return 0;
+        bindObjects();
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.buffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, mesh->IndexType, (void*)(commands.offset + groupStarts[group] * sizeof(DrawElementsIndirectCommand)),
+                                    count, 0);
+        return 1;
+#else
+        return 0;
+#endif
+    }
+
+    int groupStart(int group) const
+    {
+        return groupStarts[group];
+    }
+
+    void destroy()
+    {
+        if (heap == NULL)
+            return;
+        heap->free(objects);
+        heap->free(commands);
+    }
+
+private:
+    const Mesh* mesh = NULL;
+    GpuHeap* heap = NULL;
+    GpuAllocation objects;
+    GpuAllocation commands;
+    std::vector<int> groupStarts;       // first object of every group, then the object count
+    std::vector<int> slotOf;            // per scene node, its object or -1
+
+    void bindObjects()
+    {
+#ifdef GPU_CULLING_SUPPORTED
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECT_BINDING, objects.buffer, objects.offset, Nodes.size() * sizeof(GpuObject));
+#endif
+    }
+
+    static void pack(const SceneGraph& scene, int node, GpuObject& object)
+    {
+        object.model = scene.World[node];
+        for (int column = 0; column < 3; column++)
+            object.normalMatrix[column] = glm::vec4(scene.WorldNormal[node][column], 0.0f);
+        object.center = glm::vec4(scene.WorldCenter[node], (float)scene.Texture[node]);
+        object.extent = glm::vec4(scene.WorldExtent[node], 0.0f);
+    }
+};
+#endif
@@ -0,0 +1,454 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <vector>
+
+// Immutable buffer storage needs GL 4.4 or ARB_buffer_storage; without it the buffers are plain
+// glBufferData ones and the ring is mapped per write instead of persistently
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define GPU_BUFFER_STORAGE_SUPPORTED 1
+#endif
+
+// whether the context can create immutable (and persistently mapped) buffers
+inline bool gpuBufferStorageSupported()
+{
+#ifdef GPU_BUFFER_STORAGE_SUPPORTED
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 4))
+        return true;
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (name != NULL && strcmp(name, "GL_ARB_buffer_storage") == 0)
+            return true;
+    }
+#endif
+    return false;
+}
+
+// Hands out ranges of a fixed capacity, best fit first. Free ranges are kept by offset, so a freed
+// range merges with its neighbours, and by size, so the smallest one that fits is found in log time.
+// Padding in front of an aligned range stays free. Touches no GL.
+class FreeListAllocator
+{
+public:
+    size_t Capacity = 0;
+    size_t Used = 0;
+    unsigned int Allocations = 0;
+
+    void create(size_t capacity)
+    {
+        Capacity = capacity;
+        Used = 0;
+        Allocations = 0;
+        byOffset.clear();
+        bySize.clear();
+        if (capacity > 0)
+            insert(0, capacity);
+    }
+
+    // alignment has to be a power of two; returns false if no free range can hold size bytes
+    bool allocate(size_t size, size_t alignment, size_t& offset)
+    {
+        for (std::multimap<size_t, size_t>::iterator it = bySize.lower_bound(size); it != bySize.end(); ++it)
+        {
+            size_t start = it->second;
+            size_t end = start + it->first;
+            size_t aligned = (start + alignment - 1) & ~(alignment - 1);
+            if (aligned + size > end)
+                continue;
+            bySize.erase(it);
+            byOffset.erase(start);
+            if (aligned > start)
+                insert(start, aligned - start);
+            if (aligned + size < end)
+                insert(aligned + size, end - aligned - size);
+            offset = aligned;
+            Used += size;
+            Allocations++;
+            return true;
+        }
+        return false;
+    }
+
+    // gives back a range returned by allocate()
+    void free(size_t offset, size_t size)
+    {
+        Used -= size;
+        Allocations--;
+        std::map<size_t, size_t>::iterator next = byOffset.lower_bound(offset);
+        if (next != byOffset.end() && next->first == offset + size)
+        {
+            size += next->second;
+            erase(next);
+        }
+        std::map<size_t, size_t>::iterator previous = byOffset.lower_bound(offset);
+        if (previous != byOffset.begin())
+            --previous;
+        if (previous != byOffset.end() && previous->first + previous->second == offset)
+        {
+            offset = previous->first;
+            size += previous->second;
+            erase(previous);
+        }
+        insert(offset, size);
+    }
+
+    size_t largestFree() const
+    {
+        return bySize.empty() ? 0 : bySize.rbegin()->first;
+    }
+
+    size_t freeRanges() const
+    {
+        return byOffset.size();
+    }
+
+private:
+    std::map<size_t, size_t> byOffset;          // offset -> size
+    std::multimap<size_t, size_t> bySize;       // size -> offset
+
+    void insert(size_t offset, size_t size)
+    {
+        byOffset[offset] = size;
+        bySize.insert(std::make_pair(size, offset));
+    }
+
+    void erase(std::map<size_t, size_t>::iterator range)
+    {
+        std::pair<std::multimap<size_t, size_t>::iterator, std::multimap<size_t, size_t>::iterator> sized = bySize.equal_range(range->second);
+        for (std::multimap<size_t, size_t>::iterator it = sized.first; it != sized.second; ++it)
+            if (it->second == range->first)
+            {
+                bySize.erase(it);
+                break;
+            }
+        byOffset.erase(range);
+    }
+};
+
+// Per-frame dynamic data: one buffer split into FRAMES regions that are used in turn, each fenced
+// when its frame has been submitted, so a region is only written again once the GPU has read it.
+// With buffer storage the buffer stays mapped (persistent, coherent) and a write is a memcpy;
+// otherwise every write maps its range unsynchronized, which the fences make safe just the same.
+// A frame that did not fit makes the next beginFrame() wait for the GPU once and recreate the
+// buffer with regions large enough for it, up to MaxRegionSize.
+class GpuRingBuffer
+{
+public:
+    enum { FRAMES = 3 };
+
+    unsigned int Buffer = 0;
+    size_t RegionSize = 0;
+    size_t MaxRegionSize = 64 * 1024 * 1024;
+    size_t PeakUsed = 0;            // the most bytes a frame wrote
+    unsigned int Waits = 0;         // frames whose region the GPU was still reading
+    unsigned int Overflows = 0;     // writes that did not fit into their frame's region
+    unsigned int Resizes = 0;
+
+    void create(size_t regionSize)
+    {
+        RegionSize = regionSize;
+        needed = 0;
+        size_t size = RegionSize * FRAMES;
+        glGenBuffers(1, &Buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, Buffer);
+#ifdef GPU_BUFFER_STORAGE_SUPPORTED
+        if (gpuBufferStorageSupported())
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+            mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+            if (mapped == NULL)
+                std::cout << "ERROR::GPU_RING_BUFFER::MAP_FAILED" << std::endl;
+            return;
+        }
+#endif
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+    }
+
+    // moves on to the next region, waiting for the GPU if it still reads the frame that used it last
+    void beginFrame()
+    {
+        if (needed > RegionSize && RegionSize < MaxRegionSize)
+        {
+            size_t regionSize = RegionSize;
+            while (regionSize < needed && regionSize < MaxRegionSize)
+                regionSize *= 2;
+            destroy();
+            create(regionSize);
+            Resizes++;
+        }
+        region = (region + 1) % FRAMES;
+        head = 0;
+        GLsync& fence = fences[region];
+        if (fence)
+        {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                Waits++;
+                glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            }
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+
+    // copies data into this frame's region and returns its offset in Buffer; false if it does not fit
+    bool write(const void* data, size_t size, size_t alignment, size_t& offset)
+    {
+        size_t aligned = (head + alignment - 1) / alignment * alignment;
+        needed = std::max(needed, aligned + size);
+        if (aligned + size > RegionSize)
+        {
+            Overflows++;
+            return false;
+        }
+        offset = region * RegionSize + aligned;
+        head = aligned + size;
+        PeakUsed = std::max(PeakUsed, head);
+        if (mapped != NULL)
+        {
+            memcpy(mapped + offset, data, size);
+            return true;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, Buffer);
+        void* range = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (range == NULL)
+            return false;
+        memcpy(range, data, size);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        return true;
+    }
+
+    // after the last command that reads this frame's region
+    void endFrame()
+    {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    bool isPersistent() const
+    {
+        return mapped != NULL;
+    }
+
+    // waits for the GPU to finish with every region
+    void destroy()
+    {
+        for (GLsync& fence : fences)
+        {
+            if (fence)
+            {
+                glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(fence);
+            }
+            fence = 0;
+        }
+        if (mapped != NULL)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, Buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            mapped = NULL;
+        }
+        glDeleteBuffers(1, &Buffer);
+        Buffer = 0;
+    }
+
+private:
+    char* mapped = NULL;
+    GLsync fences[FRAMES] = {};
+    int region = FRAMES - 1;
+    size_t head = 0;
+    size_t needed = 0;              // the most bytes a frame tried to write
+};
+// A range of one of a GpuHeap's buffers
+struct GpuAllocation
+{
+    unsigned int buffer = 0;
+    size_t offset = 0;          // in bytes, also what goes into attribute and index pointers
+    size_t size = 0;
+    int block = -1;
+};
+
+// Usage of a GpuHeap, summed over its blocks
+struct GpuMemoryStats
+{
+    unsigned int buffers = 0;
+    unsigned int allocations = 0;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t largestFree = 0;
+    size_t freeRanges = 0;
+
+    // the share of the free bytes that is not in the largest free range: 0 is one contiguous hole
+    double fragmentation() const
+    {
+        size_t free = capacity - used;
+        return free > 0 ? 1.0 - (double)largestFree / free : 0.0;
+    }
+};
+
+// GPU memory for meshes and instance data: a few large buffers, each divided by a FreeListAllocator,
+// instead of a buffer object per mesh and batch. A new block of BlockSize bytes is only created when
+// no block has room; a request larger than that gets a block of its own, which goes away again once
+// it is freed. The buffers are immutable (glBufferStorage) when the context allows it.
+//
+// Every buffer is bound to GL_COPY_WRITE_BUFFER for writing, so neither the array buffer binding nor
+// the element buffer of the bound vertex array are disturbed.
+class GpuHeap
+{
+public:
+    size_t BlockSize = 16 * 1024 * 1024;
+
+    void create(size_t blockSize)
+    {
+        BlockSize = blockSize;
+        immutable = gpuBufferStorageSupported();
+    }
+
+    // alignment has to be a power of two; an empty request still gets a range, so it can be bound
+    GpuAllocation allocate(size_t size, size_t alignment = 16)
+    {
+        size = std::max(size, alignment);
+        GpuAllocation allocation;
+        for (size_t i = 0; i < blocks.size(); i++)
+            if (blocks[i].buffer != 0 && blocks[i].space.allocate(size, alignment, allocation.offset))
+                return place(allocation, (int)i, size);
+
+        int block = createBlock(std::max(size, BlockSize), size > BlockSize);
+        if (block < 0 || !blocks[block].space.allocate(size, alignment, allocation.offset))
+        {
+            std::cout << "ERROR::GPU_HEAP::OUT_OF_MEMORY: " << size << " bytes" << std::endl;
+            return GpuAllocation();
+        }
+        return place(allocation, block, size);
+    }
+
+    void free(GpuAllocation& allocation)
+    {
+        if (allocation.block < 0)
+            return;
+        Block& block = blocks[allocation.block];
+        block.space.free(allocation.offset, allocation.size);
+        if (block.dedicated && block.space.Allocations == 0)
+        {
+            glDeleteBuffers(1, &block.buffer);
+            block.buffer = 0;
+        }
+        allocation = GpuAllocation();
+    }
+
+    // writes into an allocation at offset; with a staging ring that has room the data goes through
+    // it and a GPU-side copy, so the write never waits for draws still reading the allocation
+    void write(const GpuAllocation& allocation, size_t offset, const void* data, size_t size, GpuRingBuffer* staging)
+    {
+        size_t source;
+        if (staging != NULL && staging->write(data, size, 16, source))
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, staging->Buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, source, allocation.offset + offset, size);
+            return;
+        }
+        write(allocation, offset, data, size);
+    }
+
+    void write(const GpuAllocation& allocation, size_t offset, const void* data, size_t size)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.offset + offset, size, data);
+    }
+
+    GpuMemoryStats stats() const
+    {
+        GpuMemoryStats stats;
+        for (const Block& block : blocks)
+        {
+            if (block.buffer == 0)
+                continue;
+            stats.buffers++;
+            stats.allocations += block.space.Allocations;
+            stats.capacity += block.space.Capacity;
+            stats.used += block.space.Used;
+            stats.largestFree = std::max(stats.largestFree, block.space.largestFree());
+            stats.freeRanges += block.space.freeRanges();
+        }
+        return stats;
+    }
+
+    bool isImmutable() const
+    {
+        return immutable;
+    }
+
+    // every allocation is gone with it
+    void destroy()
+    {
+        for (Block& block : blocks)
+            if (block.buffer != 0)
+                glDeleteBuffers(1, &block.buffer);
+        blocks.clear();
+    }
+
+private:
+    struct Block
+    {
+        unsigned int buffer = 0;
+        bool dedicated = false;
+        FreeListAllocator space;
+    };
+
+    std::vector<Block> blocks;
+    bool immutable = false;
+
+    GpuAllocation& place(GpuAllocation& allocation, int block, size_t size)
+    {
+        allocation.buffer = blocks[block].buffer;
+        allocation.size = size;
+        allocation.block = block;
+        return allocation;
+    }
+
+    // reuses the slot of a freed dedicated block; returns -1 if GL could not provide the storage
+    int createBlock(size_t size, bool dedicated)
+    {
+        Block block;
+        block.dedicated = dedicated;
+        block.space.create(size);
+        glGenBuffers(1, &block.buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block.buffer);
+#ifdef GPU_BUFFER_STORAGE_SUPPORTED
+        if (immutable)
+            glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_STORAGE_BIT);
+        else
+#endif
+            glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+        if (glGetError() == GL_OUT_OF_MEMORY)
+        {
+            glDeleteBuffers(1, &block.buffer);
+            return -1;
+        }
+
+        for (size_t i = 0; i < blocks.size(); i++)
+            if (blocks[i].buffer == 0)
+            {
+                blocks[i] = block;
+                return (int)i;
+            }
+        blocks.push_back(block);
+        return (int)blocks.size() - 1;
+    }
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <iostream>
+
+// Creates an OpenGL context that has no visible window, so the scene can be rendered on
+// machines without a display (e.g. Mesa llvmpipe on a build box). On Linux this is an EGL
+// surfaceless context; elsewhere it falls back to a hidden GLFW window.
+class HeadlessContext
+{
+public:
+    bool create(int major, int minor)
+    {
+#if defined(__linux__)
+        if (createEGL(major, minor))
+            return true;
+        std::cout << "EGL surfaceless context unavailable, falling back to a hidden GLFW window" << std::endl;
+#endif
+        return createHiddenWindow(major, minor);
+    }
+
+    // pass this to gladLoadGLLoader once the context is current
+    static void* getProcAddress(const char* name)
+    {
+#if defined(__linux__)
+        if (usingEGL())
+            return (void*)eglGetProcAddress(name);
+#endif
+        return (void*)glfwGetProcAddress(name);
+    }
+
+    void destroy()
+    {
+#if defined(__linux__)
+        if (display != EGL_NO_DISPLAY)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+            context = EGL_NO_CONTEXT;
+        }
+#endif
+        if (window != NULL)
+        {
+            glfwDestroyWindow(window);
+            window = NULL;
+        }
+    }
+
+private:
+    GLFWwindow* window = NULL;
+#if defined(__linux__)
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    static bool& usingEGL()
+    {
+        static bool flag = false;
+        return flag;
+    }
+
+    bool createEGL(int major, int minor)
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay == NULL)
+            return false;
+
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        {
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            destroy();
+            return false;
+        }
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        // surfaceless contexts are created without a config (EGL_KHR_no_config_context)
+        context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            destroy();
+            return false;
+        }
+
+        usingEGL() = true;
+        return true;
+    }
+#endif
+
+    bool createHiddenWindow(int major, int minor)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+        window = glfwCreateWindow(64, 64, "Torture Chamber (headless)", NULL, NULL);
+        if (window == NULL)
+            return false;
+        glfwMakeContextCurrent(window);
+        return true;
+    }
+};
+
+// Color + depth render target that stands in for the default framebuffer in headless mode.
+class OffscreenTarget
+{
+public:
+    unsigned int FBO = 0;
+    unsigned int colorRBO = 0;
+    unsigned int depthRBO = 0;
+    int Width = 0;
+    int Height = 0;
+
+    bool create(int width, int height)
+    {
+        Width = width;
+        Height = height;
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+        glGenRenderbuffers(1, &colorRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "ERROR::FRAMEBUFFER:: Offscreen framebuffer is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return complete;
+    }
+
+    void bind()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, Width, Height);
+    }
+
+    void destroy()
+    {
+        glDeleteRenderbuffers(1, &colorRBO);
+        glDeleteRenderbuffers(1, &depthRBO);
+        glDeleteFramebuffers(1, &FBO);
+    }
+};
+#endif
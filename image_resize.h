@@ -0,0 +1,52 @@
+#ifndef IMAGE_RESIZE_H
+#define IMAGE_RESIZE_H
+
+#include <vector>
+
+// Bilinear resample of a tightly packed 8-bit image, used to bring differently sized images to the array size
+inline std::vector<unsigned char> resizeImage(const unsigned char* src, int srcWidth, int srcHeight, int channels, int dstWidth, int dstHeight)
+{
+    std::vector<unsigned char> dst((size_t)dstWidth * dstHeight * channels);
+    if (srcWidth == dstWidth && srcHeight == dstHeight)
+    {
+        dst.assign(src, src + dst.size());
+        return dst;
+    }
+
+    float scaleX = (float)srcWidth / dstWidth;
+    float scaleY = (float)srcHeight / dstHeight;
+    for (int y = 0; y < dstHeight; y++)
+    {
+        // sample at pixel centers
+        float sy = (y + 0.5f) * scaleY - 0.5f;
+        if (sy < 0.0f)
+            sy = 0.0f;
+        int y0 = (int)sy;
+        int y1 = y0 + 1 < srcHeight ? y0 + 1 : srcHeight - 1;
+        float fy = sy - y0;
+
+        for (int x = 0; x < dstWidth; x++)
+        {
+            float sx = (x + 0.5f) * scaleX - 0.5f;
+            if (sx < 0.0f)
+                sx = 0.0f;
+            int x0 = (int)sx;
+            int x1 = x0 + 1 < srcWidth ? x0 + 1 : srcWidth - 1;
+            float fx = sx - x0;
+
+            const unsigned char* p00 = src + ((size_t)y0 * srcWidth + x0) * channels;
+            const unsigned char* p01 = src + ((size_t)y0 * srcWidth + x1) * channels;
+            const unsigned char* p10 = src + ((size_t)y1 * srcWidth + x0) * channels;
+            const unsigned char* p11 = src + ((size_t)y1 * srcWidth + x1) * channels;
+            unsigned char* out = &dst[((size_t)y * dstWidth + x) * channels];
+            for (int c = 0; c < channels; c++)
+            {
+                float top = p00[c] + (p01[c] - p00[c]) * fx;
+                float bottom = p10[c] + (p11[c] - p10[c]) * fx;
+                out[c] = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+            }
+        }
+    }
+    return dst;
+}
+#endif
@@ -0,0 +1,99 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Binary recording of the camera input and the scene time of every frame, written with --record and
+// fed back with --replay so a run reproduces the same camera path and animation, frame by frame.
+//
+//   InputFileHeader
+//   InputRecord[frameCount]
+//
+// All values are little-endian. Record i holds the input applied just before frame i was built:
+// keys held, mouse and wheel motion since frame i - 1, and the frame's time.
+
+const char INPUT_FILE_MAGIC[4] = { 'I', 'N', 'P', 'T' };
+const uint32_t INPUT_FILE_VERSION = 1;
+
+enum InputKey
+{
+    INPUT_KEY_FORWARD = 1,
+    INPUT_KEY_BACKWARD = 2,
+    INPUT_KEY_LEFT = 4,
+    INPUT_KEY_RIGHT = 8
+};
+
+struct InputFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t frameCount;
+    uint32_t recordSize;        // sizeof(InputRecord)
+    uint32_t width;             // the viewport it was recorded at; the projection depends on it
+    uint32_t height;
+};
+
+struct InputRecord
+{
+    float time;                 // scene time of the frame in seconds
+    float deltaTime;            // since the previous frame, scales the camera movement
+    float mouse[2];             // cursor offset, y pointing up
+    float scroll;
+    uint32_t keys;              // InputKey bits
+};
+
+static_assert(sizeof(InputRecord) == 24, "InputRecord must stay tightly packed");
+
+class InputRecording
+{
+public:
+    std::vector<InputRecord> Frames;
+    int Width = 0, Height = 0;
+
+    bool load(const char* path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        InputFileHeader header;
+        if (!in.read((char*)&header, sizeof header) || memcmp(header.magic, INPUT_FILE_MAGIC, 4) != 0 ||
+            header.version != INPUT_FILE_VERSION || header.recordSize != sizeof(InputRecord))
+        {
+            std::cout << "ERROR::INPUT_RECORDING::INVALID_FILE: " << path << std::endl;
+            return false;
+        }
+        Frames.resize(header.frameCount);
+        if (!Frames.empty() && !in.read((char*)Frames.data(), Frames.size() * sizeof(InputRecord)))
+        {
+            std::cout << "ERROR::INPUT_RECORDING::TRUNCATED: " << path << std::endl;
+            return false;
+        }
+        Width = (int)header.width;
+        Height = (int)header.height;
+        return true;
+    }
+
+    bool save(const char* path) const
+    {
+        std::ofstream out(path, std::ios::binary);
+        InputFileHeader header;
+        memcpy(header.magic, INPUT_FILE_MAGIC, 4);
+        header.version = INPUT_FILE_VERSION;
+        header.frameCount = (uint32_t)Frames.size();
+        header.recordSize = sizeof(InputRecord);
+        header.width = (uint32_t)Width;
+        header.height = (uint32_t)Height;
+        out.write((const char*)&header, sizeof header);
+        out.write((const char*)Frames.data(), Frames.size() * sizeof(InputRecord));
+        if (!out)
+        {
+            std::cout << "ERROR::INPUT_RECORDING::WRITE_FAILED: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+#endif
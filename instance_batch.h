@@ -0,0 +1,184 @@
+#ifndef INSTANCE_BATCH_H
+#define INSTANCE_BATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include "frame_arena.h"
+#include "gpu_memory.h"
+#include "scene_graph.h"
+
+// Per-instance vertex data: attribute locations 4-7 hold the model matrix columns, 8 the texture
+// array layer and 9-11 the normal matrix columns
+struct InstanceData
+{
+    glm::mat4 model;
+    GLfloat layer;
+    glm::mat3 normal;
+};
+
+const unsigned int INSTANCE_MODEL_ATTRIB = 4;
+const unsigned int INSTANCE_LAYER_ATTRIB = 8;
+const unsigned int INSTANCE_NORMAL_ATTRIB = 9;
+
+// The instances of a batch that changed in one frame, gathered off the GL thread and uploaded later
+struct InstanceUpload
+{
+    GLsizei count = 0;                      // instances drawn
+    int first = 0;                          // buffer slot of instances[0]
+    FrameVector<InstanceData> instances;
+};
+
+// All scene nodes of one material, kept in a range of a GpuHeap so they can be drawn with a
+// single instanced draw call. Only the nodes that survived culling are in the buffer; while that
+// set stays the same, only instances whose world matrix changed are re-uploaded.
+//
+// gather() and upload() split a frame's update: gather only reads the scene and may run on a worker
+// while the GL thread is still uploading an earlier InstanceUpload; uploads must come in gather order.
+class InstanceBatch
+{
+public:
+    GpuAllocation Buffer;
+    std::vector<int> Nodes;                 // every node of the material
+    std::vector<int> DrawnNodes;            // the visible ones, in buffer order
+    std::vector<InstanceData> Instances;    // CPU copy of the buffer, one per drawn node, as of the last gather
+
+    // collects every node of the given material, sizes the buffer for all of them and uploads them
+    void build(const SceneGraph& scene, Material material, GpuHeap& heap)
+    {
+        std::vector<int> nodes;
+        for (size_t i = 0; i < scene.size(); i++)
+            if (scene.NodeMaterial[i] == material)
+                nodes.push_back((int)i);
+        build(scene, nodes, heap);
+    }
+
+    // the same for an explicit set of nodes, e.g. the shadow casters
+    void build(const SceneGraph& scene, const std::vector<int>& nodes, GpuHeap& heap)
+    {
+        Nodes = nodes;
+        destroy();
+        this->heap = &heap;
+        Buffer = heap.allocate(Nodes.size() * sizeof(InstanceData));
+        fill(scene, Nodes);
+    }
+
+    // collects what brings the buffer up to date after the scene's last update() and culling;
+    // visible[node] is non-zero for the nodes that should be drawn
+    void gather(const SceneGraph& scene, const std::vector<unsigned char>& visible, InstanceUpload& changes)
+    {
+        visibleNodes.clear();
+        for (int node : Nodes)
+            if (visible[node])
+                visibleNodes.push_back(node);
+        if (visibleNodes != DrawnNodes)
+        {
+            assign(scene, visibleNodes);
+            changes.count = (GLsizei)Instances.size();
+            changes.first = 0;
+            changes.instances.assign(Instances.begin(), Instances.end());
+            return;
+        }
+
+        // same set as last frame: re-upload the range of instances touched by the update
+        int first = (int)Instances.size();
+        int last = -1;
+        for (int node : scene.Changed)
+        {
+            int slot = node < (int)slotOf.size() ? slotOf[node] : -1;
+            if (slot < 0)
+                continue;
+            Instances[slot].model = scene.World[node];
+            Instances[slot].normal = scene.WorldNormal[node];
+            if (slot < first)
+                first = slot;
+            if (slot > last)
+                last = slot;
+        }
+        changes.count = (GLsizei)Instances.size();
+        changes.first = first;
+        if (last < first)
+            changes.instances.clear();
+        else
+            changes.instances.assign(Instances.begin() + first, Instances.begin() + last + 1);
+    }
+
+    // writes gathered changes into the buffer, through the staging ring if one is given
+    void upload(const InstanceUpload& changes, GpuRingBuffer* staging = NULL)
+    {
+        drawn = changes.count;
+        if (changes.instances.empty())
+            return;
+        heap->write(Buffer, changes.first * sizeof(InstanceData), changes.instances.data(), changes.instances.size() * sizeof(InstanceData), staging);
+    }
+
+    // adds the per-instance attributes to a VAO that already holds the per-vertex ones
+    void attach(unsigned int vao)
+    {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, Buffer.buffer);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(INSTANCE_MODEL_ATTRIB + column);
+            glVertexAttribPointer(INSTANCE_MODEL_ATTRIB + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(Buffer.offset + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_MODEL_ATTRIB + column, 1);
+        }
+        glEnableVertexAttribArray(INSTANCE_LAYER_ATTRIB);
+        glVertexAttribPointer(INSTANCE_LAYER_ATTRIB, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(Buffer.offset + offsetof(InstanceData, layer)));
+        glVertexAttribDivisor(INSTANCE_LAYER_ATTRIB, 1);
+        for (unsigned int column = 0; column < 3; column++)
+        {
+            glEnableVertexAttribArray(INSTANCE_NORMAL_ATTRIB + column);
+            glVertexAttribPointer(INSTANCE_NORMAL_ATTRIB + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(Buffer.offset + offsetof(InstanceData, normal) + column * sizeof(glm::vec3)));
+            glVertexAttribDivisor(INSTANCE_NORMAL_ATTRIB + column, 1);
+        }
+    }
+
+    // instances in the buffer as of the last upload
+    GLsizei count() const
+    {
+        return drawn;
+    }
+
+    void destroy()
+    {
+        if (heap != NULL)
+            heap->free(Buffer);
+    }
+
+private:
+    GpuHeap* heap = NULL;
+    std::vector<int> slotOf;            // per scene node, its instance in the buffer or -1
+    std::vector<int> visibleNodes;
+    GLsizei drawn = 0;
+
+    // makes nodes the drawn set and uploads all of their instances
+    void fill(const SceneGraph& scene, const std::vector<int>& nodes)
+    {
+        assign(scene, nodes);
+        drawn = (GLsizei)Instances.size();
+        if (Instances.empty())
+            return;
+        heap->write(Buffer, 0, Instances.data(), Instances.size() * sizeof(InstanceData));
+    }
+
+    // makes nodes the drawn set in the CPU copy
+    void assign(const SceneGraph& scene, const std::vector<int>& nodes)
+    {
+        DrawnNodes = nodes;
+        Instances.resize(nodes.size());
+        slotOf.assign(scene.size(), -1);
+        for (size_t slot = 0; slot < nodes.size(); slot++)
+        {
+            int node = nodes[slot];
+            slotOf[node] = (int)slot;
+            Instances[slot].model = scene.World[node];
+            Instances[slot].normal = scene.WorldNormal[node];
+            Instances[slot].layer = (GLfloat)scene.Texture[node];
+        }
+    }
+};
+#endif
@@ -0,0 +1,359 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+
+class JobSystem;
+
+// A set of jobs with dependencies, e.g. the CPU work of one frame. The graph is built once and can
+// be run again and again; a job becomes ready once every job it depends on has finished.
+class JobGraph
+{
+public:
+    std::chrono::steady_clock::time_point Finished;     // when the last job of the last run finished
+
+    // returns the job's index, for depend()
+    int add(std::function<void()> task)
+    {
+        jobs.emplace_back(new Node());
+        jobs.back()->task = std::move(task);
+        jobs.back()->graph = this;
+        return (int)jobs.size() - 1;
+    }
+
+    // job only starts once prerequisite has finished
+    void depend(int job, int prerequisite)
+    {
+        jobs[prerequisite]->successors.push_back(job);
+        jobs[job]->dependencies++;
+    }
+
+    bool done() const
+    {
+        return complete;
+    }
+
+private:
+    friend class JobSystem;
+
+    struct Node
+    {
+        std::function<void()> task;
+        JobGraph* graph = NULL;
+        std::vector<int> successors;
+        int dependencies = 0;
+        std::atomic<int> waiting;       // prerequisites of the current run that have not finished
+    };
+
+    std::vector<std::unique_ptr<Node> > jobs;
+    std::atomic<int> unfinished{ 0 };
+    std::atomic<bool> complete{ true };     // set after Finished
+};
+
+// Work-stealing job system for the per-frame CPU work. Every thread has its own deque: it pushes and
+// pops new jobs at the back (the most recent, still cache-warm work first) and, when it runs dry,
+// steals from the front of another thread's deque (the oldest, usually largest pieces of work).
+// The thread that started the system takes part as thread 0 whenever it waits, so jobs may wait on
+// other jobs (parallelFor inside a job) without tying up a worker; with one thread everything simply
+// runs on the caller. Idle workers sleep instead of spinning, so they cost nothing while the caller
+// submits GL work. Jobs must not touch the GL context.
+//
+// Once the deques have grown to the largest frame, running a graph or a parallelFor allocates
+// nothing: the jobs the system creates itself capture two pointers, which std::function keeps
+// inline, and the deques are rings that never shrink.
+class JobSystem
+{
+public:
+    typedef std::function<void()> Job;
+
+    // threadCount counts the calling thread; 0 uses every hardware thread
+    void start(int threadCount = 0)
+    {
+        if (threadCount <= 0)
+            threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+        stopping = false;
+        queues.clear();
+        for (int i = 0; i < threadCount; i++)
+            queues.emplace_back(new Queue());
+        current() = Current(this, 0);
+        for (int i = 1; i < threadCount; i++)
+            workers.emplace_back(&JobSystem::serve, this, i);
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    // worker threads, not counting the caller
+    int size() const
+    {
+        return (int)workers.size();
+    }
+
+    // the running thread's index, 0 for the caller and threads outside any system
+    static int threadIndex()
+    {
+        return current().index;
+    }
+
+    // queues the jobs of the graph that have no prerequisites and returns; wait() finishes the run
+    void launch(JobGraph& graph)
+    {
+        graph.complete = false;
+        graph.unfinished = (int)graph.jobs.size();
+        for (std::unique_ptr<JobGraph::Node>& node : graph.jobs)
+            node->waiting = node->dependencies;
+        for (size_t i = 0; i < graph.jobs.size(); i++)
+            if (graph.jobs[i]->dependencies == 0)
+                push(graphJob(graph, (int)i));
+        if (graph.jobs.empty())
+        {
+            graph.Finished = std::chrono::steady_clock::now();
+            graph.complete = true;
+        }
+    }
+
+    // runs jobs until the graph is done
+    void wait(JobGraph& graph)
+    {
+        waitUntil([&graph] { return graph.done(); });
+    }
+
+    void run(JobGraph& graph)
+    {
+        launch(graph);
+        wait(graph);
+    }
+
+    // runs task(0) .. task(count - 1) on any thread and returns once all are done; may be called from a job
+    template <typename Task>
+    void parallelFor(int count, const Task& task)
+    {
+        // lives on this stack: helpers that start late find no index left and never touch task, and
+        // this call only returns once every helper it queued has let go of the batch
+        struct Batch
+        {
+            const Task* task;
+            int count;
+            std::atomic<int> next;
+            std::atomic<int> done;
+            std::atomic<int> helpers;
+        } batch;
+        batch.task = &task;
+        batch.count = count;
+        batch.next = 0;
+        batch.done = 0;
+        int helpers = std::min(size(), count - 1);
+        batch.helpers = helpers;
+
+        for (int i = 0; i < helpers; i++)
+            push([this, &batch]() {
+                run(batch);
+                if (--batch.helpers == 0)
+                    finished();
+            });
+        run(batch);
+        waitUntil([&batch, count] { return batch.done == count && batch.helpers == 0; });
+    }
+
+private:
+    // a deque of jobs in a ring that only ever grows
+    class Ring
+    {
+    public:
+        bool empty() const
+        {
+            return count == 0;
+        }
+
+        void push_back(Job&& job)
+        {
+            if (count == slots.size())
+            {
+                std::vector<Job> grown(std::max<size_t>(16, 2 * slots.size()));
+                for (size_t i = 0; i < count; i++)
+                    grown[i] = std::move(slots[(first + i) % slots.size()]);
+                slots.swap(grown);
+                first = 0;
+            }
+            slots[(first + count++) % slots.size()] = std::move(job);
+        }
+
+        Job pop_back()
+        {
+            return std::move(slots[(first + --count) % slots.size()]);
+        }
+
+        Job pop_front()
+        {
+            Job& job = slots[first];
+            first = (first + 1) % slots.size();
+            count--;
+            return std::move(job);
+        }
+
+    private:
+        std::vector<Job> slots;
+        size_t first = 0;
+        size_t count = 0;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        Ring jobs;
+    };
+
+    // the system and deque index of the running thread
+    struct Current
+    {
+        JobSystem* system;
+        int index;
+        Current(JobSystem* system = NULL, int index = 0) : system(system), index(index) {}
+    };
+
+    std::vector<std::unique_ptr<Queue> > queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    static Current& current()
+    {
+        static thread_local Current thread;
+        return thread;
+    }
+
+    // this thread's deque; threads outside the system share the caller's
+    int self() const
+    {
+        return current().system == this ? current().index : 0;
+    }
+
+    void push(Job job)
+    {
+        Queue& queue = *queues[self()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(std::move(job));
+        }
+        queued++;
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_one();
+    }
+
+    // the newest job of our own deque, else the oldest of somebody else's
+    bool take(Job& job)
+    {
+        if (queued == 0)
+            return false;
+        int index = self();
+        int count = (int)queues.size();
+        for (int i = 0; i < count; i++)
+        {
+            Queue& queue = *queues[(index + i) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+                continue;
+            job = i == 0 ? queue.jobs.pop_back() : queue.jobs.pop_front();
+            queued--;
+            return true;
+        }
+        return false;
+    }
+
+    // wakes every thread that waits for something to finish
+    void finished()
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_all();
+    }
+
+    // runs queued jobs until done() holds, sleeping while there is nothing to run
+    template <typename Condition>
+    void waitUntil(Condition done)
+    {
+        while (!done())
+        {
+            Job job;
+            if (take(job))
+            {
+                job();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this, &done] { return queued > 0 || done(); });
+        }
+    }
+
+    // a graph job runs its task, then queues the successors it was the last prerequisite of
+    Job graphJob(JobGraph& graph, int index)
+    {
+        JobGraph::Node* node = graph.jobs[index].get();
+        return [this, node]() {
+            JobGraph& graph = *node->graph;
+            node->task();
+            for (int successor : node->successors)
+                if (--graph.jobs[successor]->waiting == 0)
+                    push(graphJob(graph, successor));
+            if (--graph.unfinished == 0)
+            {
+                graph.Finished = std::chrono::steady_clock::now();
+                graph.complete = true;
+                finished();
+            }
+        };
+    }
+
+    // takes indices of a parallelFor batch until none are left
+    template <typename Batch>
+    void run(Batch& batch)
+    {
+        for (int i = batch.next++; i < batch.count; i = batch.next++)
+        {
+            (*batch.task)(i);
+            if (++batch.done == batch.count)
+                finished();
+        }
+    }
+
+    // a worker's loop
+    void serve(int index)
+    {
+        current() = Current(this, index);
+        PROFILE_THREAD("job worker");
+        for (;;)
+        {
+            Job job;
+            if (take(job))
+            {
+                job();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0)
+                return;
+        }
+    }
+};
+#endif
@@ -0,0 +1,193 @@
+#ifndef KTX_FORMAT_H
+#define KTX_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+// KTX 1.1 texture container written by tools/texbake and uploaded by TextureArray (texture_array.h).
+//
+//   KtxHeader
+//   key/value data                       bytesOfKeyValueData bytes
+//   per mip level, largest first:
+//     uint32_t imageSize
+//     imageSize bytes of compressed blocks, padded to 4 bytes
+//
+// Only what the baker writes is supported: little-endian, block-compressed 2D images with one face.
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+struct KtxHeader
+{
+    unsigned char identifier[12];
+    uint32_t endianness;
+    uint32_t glType;                // 0 for compressed formats
+    uint32_t glTypeSize;
+    uint32_t glFormat;              // 0 for compressed formats
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+// bytes per 4x4 block of the supported formats, 0 if the format is not one of them
+inline uint32_t ktxBlockBytes(uint32_t internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return 8;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM: return 16;
+    default: return 0;
+    }
+}
+
+// size in bytes of one compressed mip level
+inline uint32_t ktxLevelSize(uint32_t internalFormat, uint32_t width, uint32_t height)
+{
+    return ((width + 3) / 4) * ((height + 3) / 4) * ktxBlockBytes(internalFormat);
+}
+
+// whether the header describes a file the loader understands
+inline bool ktxHeaderSupported(const KtxHeader& header)
+{
+    return memcmp(header.identifier, KTX_IDENTIFIER, sizeof KTX_IDENTIFIER) == 0 && header.endianness == KTX_ENDIANNESS &&
+           header.glType == 0 && ktxBlockBytes(header.glInternalFormat) != 0 && header.pixelDepth == 0 &&
+           header.numberOfArrayElements == 0 && header.numberOfFaces == 1 && header.numberOfMipmapLevels != 0;
+}
+
+// reads just the header, so the texture's format and size are known before its data is loaded
+inline bool readKtxHeader(const char* path, KtxHeader& header)
+{
+    std::ifstream file(path, std::ios::binary);
+    return file.read((char*)&header, sizeof header) && ktxHeaderSupported(header);
+}
+
+// one 4x4 block of a single opaque color, e.g. to fill placeholder textures
+inline void ktxSolidBlock(uint32_t internalFormat, unsigned char r, unsigned char g, unsigned char b, unsigned char* block)
+{
+    memset(block, 0, ktxBlockBytes(internalFormat));
+    if (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+    {
+        // color0 == color1 with all indices 0
+        uint16_t color = (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+        block[0] = block[2] = (unsigned char)(color & 0xff);
+        block[1] = block[3] = (unsigned char)(color >> 8);
+    }
+    else if (internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM)
+    {
+        // mode 6 with equal 7-bit endpoints, both p-bits set (alpha 255) and all indices 0
+        uint32_t r7 = r >> 1u, g7 = g >> 1u, b7 = b >> 1u;
+        uint32_t fields[8] = { r7, r7, g7, g7, b7, b7, 127, 127 };
+        int position = 7;
+        block[0] = 1 << 6;
+        for (int f = 0; f < 8; f++)
+            for (int bit = 0; bit < 7; bit++, position++)
+                if (fields[f] & (1u << bit))
+                    block[position >> 3] |= (unsigned char)(1u << (position & 7));
+        block[position >> 3] |= (unsigned char)(1u << (position & 7));
+        position++;
+        block[position >> 3] |= (unsigned char)(1u << (position & 7));
+    }
+}
+
+struct KtxLevel
+{
+    int Width;
+    int Height;
+    const char* Data;
+    uint32_t Size;
+};
+
+// A parsed KTX file; the levels point into the file's bytes, so they can be handed to GL as-is.
+class KtxFile
+{
+public:
+    uint32_t InternalFormat = 0;
+    int Width = 0;
+    int Height = 0;
+    std::vector<KtxLevel> Levels;
+
+    // returns false without a message if the file does not exist, so callers can fall back to the source image
+    bool load(const char* path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return parse(bytes.data(), bytes.size(), path);
+    }
+
+    // the file's bytes must stay alive as long as the levels are used
+    bool loadFromMemory(const char* data, size_t size, const char* name)
+    {
+        bytes.clear();
+        return parse(data, size, name);
+    }
+
+private:
+    std::vector<char> bytes;
+
+    bool parse(const char* data, size_t size, const char* name)
+    {
+        Levels.clear();
+        KtxHeader header;
+        if (size < sizeof header)
+        {
+            std::cout << "ERROR::KTX::TRUNCATED: " << name << std::endl;
+            return false;
+        }
+        memcpy(&header, data, sizeof header);
+        if (!ktxHeaderSupported(header))
+        {
+            std::cout << "ERROR::KTX::UNSUPPORTED_FORMAT: " << name << " (rebake it with tools/texbake)" << std::endl;
+            return false;
+        }
+
+        InternalFormat = header.glInternalFormat;
+        Width = (int)header.pixelWidth;
+        Height = (int)header.pixelHeight;
+
+        size_t offset = sizeof header + header.bytesOfKeyValueData;
+        int width = Width, height = Height;
+        for (uint32_t level = 0; level < header.numberOfMipmapLevels; level++)
+        {
+            uint32_t imageSize;
+            if (offset + sizeof imageSize > size)
+                break;
+            memcpy(&imageSize, data + offset, sizeof imageSize);
+            offset += sizeof imageSize;
+            if (imageSize != ktxLevelSize(InternalFormat, width, height) || offset + imageSize > size)
+                break;
+
+            KtxLevel entry = { width, height, data + offset, imageSize };
+            Levels.push_back(entry);
+            offset += (imageSize + 3) & ~3u;
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+        if (Levels.size() != header.numberOfMipmapLevels)
+        {
+            std::cout << "ERROR::KTX::TRUNCATED: " << name << std::endl;
+            Levels.clear();
+            return false;
+        }
+        return true;
+    }
+};
+#endif
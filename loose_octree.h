@@ -0,0 +1,212 @@
+#ifndef LOOSE_OCTREE_H
+#define LOOSE_OCTREE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <learnopenggl/camera.h>
+
+#include "scene_graph.h"
+
+// A loose octree over the bounding boxes of a scene's drawn nodes, for frustum culling.
+//
+// Every cell's bounds are loosened to twice its size, so an object only has to be as small as half
+// a cell and have its center inside it to fit; where it goes depends on nothing but its center and
+// size. Moving an object therefore is a walk down from the root and, only if it ends in another
+// cell, an O(1) removal and insertion. Cells are created on demand and never freed. A cell's objects
+// are a list linked through per-object arrays, so moving objects around allocates nothing.
+class LooseOctree
+{
+public:
+    enum { NO_CELL = -1, NO_OBJECT = -1, MAX_DEPTH = 8 };
+
+    // sizes the root to the scene's current bounds and inserts every drawn node
+    void build(const SceneGraph& scene)
+    {
+        glm::vec3 low(0.0f), high(0.0f);
+        bool first = true;
+        for (size_t id = 0; id < scene.size(); id++)
+        {
+            if (!scene.isDrawn((int)id))
+                continue;
+            glm::vec3 objectLow = scene.WorldCenter[id] - scene.WorldExtent[id];
+            glm::vec3 objectHigh = scene.WorldCenter[id] + scene.WorldExtent[id];
+            low = first ? objectLow : glm::min(low, objectLow);
+            high = first ? objectHigh : glm::max(high, objectHigh);
+            first = false;
+        }
+
+        glm::vec3 size = high - low;
+        cells.clear();
+        cells.push_back(Cell((low + high) * 0.5f, std::max(size.x, std::max(size.y, size.z)) * 0.5f, NO_CELL));
+        objectCell.assign(scene.size(), NO_CELL);
+        objectNext.assign(scene.size(), NO_OBJECT);
+        objectPrevious.assign(scene.size(), NO_OBJECT);
+        objectCount = 0;
+        for (size_t id = 0; id < scene.size(); id++)
+            if (scene.isDrawn((int)id))
+                insert((int)id, scene.WorldCenter[id], scene.WorldExtent[id]);
+
+        // room for as many cells again as the scene needed, for the ones moving objects open later
+        cells.reserve(cells.size() * 2);
+    }
+
+    // moves the drawn nodes whose bounds changed in the scene's last update()
+    void update(const SceneGraph& scene)
+    {
+        if (objectCell.size() < scene.size())
+        {
+            objectCell.resize(scene.size(), NO_CELL);
+            objectNext.resize(scene.size(), NO_OBJECT);
+            objectPrevious.resize(scene.size(), NO_OBJECT);
+        }
+        for (int id : scene.Changed)
+            if (scene.isDrawn(id))
+                insert(id, scene.WorldCenter[id], scene.WorldExtent[id]);
+    }
+
+    // appends the ids of all objects whose box intersects the frustum
+    void cull(const SceneGraph& scene, const Frustum& frustum, std::vector<int>& visible) const
+    {
+        if (cells.empty())
+            return;
+
+        // the root also keeps whatever did not fit into it, so its own objects are always tested
+        const Cell& root = cells[0];
+        for (int id = root.first; id != NO_OBJECT; id = objectNext[id])
+            if (frustum.test(scene.WorldCenter[id], scene.WorldExtent[id]) != Frustum::OUTSIDE)
+                visible.push_back(id);
+        for (int child : root.children)
+            if (child != NO_CELL)
+                cullCell(scene, frustum, child, visible);
+    }
+
+    int size() const
+    {
+        return objectCount;
+    }
+
+private:
+    struct Cell
+    {
+        glm::vec3 center;
+        float halfSize;             // of the cell itself; its loose bounds are twice as large
+        int parent;
+        int children[8];
+        int count;                  // objects in this cell and all cells below it
+        int first;                  // of the cell's own objects, NO_OBJECT if none
+
+        Cell(const glm::vec3& center, float halfSize, int parent) : center(center), halfSize(halfSize), parent(parent), count(0), first(NO_OBJECT)
+        {
+            std::fill(children, children + 8, (int)NO_CELL);
+        }
+    };
+
+    std::vector<Cell> cells;
+    std::vector<int> objectCell;    // per scene node, NO_CELL if it is not in the tree
+    std::vector<int> objectNext;    // per scene node, the next and previous object of its cell
+    std::vector<int> objectPrevious;
+    int objectCount = 0;
+
+    // the deepest cell whose loose bounds contain the box: center inside the cell, extent at most half a cell
+    int findCell(const glm::vec3& center, const glm::vec3& extent)
+    {
+        float radius = std::max(extent.x, std::max(extent.y, extent.z));
+        glm::vec3 offset = glm::abs(center - cells[0].center);
+        if (std::max(offset.x, std::max(offset.y, offset.z)) > cells[0].halfSize)
+            return 0;
+
+        int cell = 0;
+        for (int depth = 0; depth < MAX_DEPTH; depth++)
+        {
+            float childHalf = cells[cell].halfSize * 0.5f;
+            if (radius > childHalf)
+                break;
+            glm::vec3 cellCenter = cells[cell].center;
+            int octant = (center.x >= cellCenter.x ? 1 : 0) | (center.y >= cellCenter.y ? 2 : 0) | (center.z >= cellCenter.z ? 4 : 0);
+            if (cells[cell].children[octant] == NO_CELL)
+            {
+                glm::vec3 childCenter = cellCenter + glm::vec3(octant & 1 ? childHalf : -childHalf,
+                                                               octant & 2 ? childHalf : -childHalf,
+                                                               octant & 4 ? childHalf : -childHalf);
+                int child = (int)cells.size();
+                cells.push_back(Cell(childCenter, childHalf, cell));
+                cells[cell].children[octant] = child;
+            }
+            cell = cells[cell].children[octant];
+        }
+        return cell;
+    }
+
+    // inserts the object, or moves it if it is already in the tree
+    void insert(int id, const glm::vec3& center, const glm::vec3& extent)
+    {
+        int cell = findCell(center, extent);
+        int current = objectCell[id];
+        if (cell == current)
+            return;
+
+        if (current != NO_CELL)
+        {
+            // unlink from the old cell
+            int next = objectNext[id], previous = objectPrevious[id];
+            if (previous != NO_OBJECT)
+                objectNext[previous] = next;
+            else
+                cells[current].first = next;
+            if (next != NO_OBJECT)
+                objectPrevious[next] = previous;
+            for (int c = current; c != NO_CELL; c = cells[c].parent)
+                cells[c].count--;
+        }
+        else
+        {
+            objectCount++;
+        }
+
+        objectCell[id] = cell;
+        objectPrevious[id] = NO_OBJECT;
+        objectNext[id] = cells[cell].first;
+        if (cells[cell].first != NO_OBJECT)
+            objectPrevious[cells[cell].first] = id;
+        cells[cell].first = id;
+        for (int c = cell; c != NO_CELL; c = cells[c].parent)
+            cells[c].count++;
+    }
+
+    void cullCell(const SceneGraph& scene, const Frustum& frustum, int index, std::vector<int>& visible) const
+    {
+        const Cell& cell = cells[index];
+        if (cell.count == 0)
+            return;
+        Frustum::Result result = frustum.test(cell.center, glm::vec3(cell.halfSize * 2.0f));
+        if (result == Frustum::OUTSIDE)
+            return;
+        if (result == Frustum::INSIDE)
+        {
+            collect(index, visible);
+            return;
+        }
+
+        for (int id = cell.first; id != NO_OBJECT; id = objectNext[id])
+            if (frustum.test(scene.WorldCenter[id], scene.WorldExtent[id]) != Frustum::OUTSIDE)
+                visible.push_back(id);
+        for (int child : cell.children)
+            if (child != NO_CELL)
+                cullCell(scene, frustum, child, visible);
+    }
+
+    // a cell entirely inside the frustum: everything below it is visible without further tests
+    void collect(int index, std::vector<int>& visible) const
+    {
+        const Cell& cell = cells[index];
+        for (int id = cell.first; id != NO_OBJECT; id = objectNext[id])
+            visible.push_back(id);
+        for (int child : cell.children)
+            if (child != NO_CELL && cells[child].count > 0)
+                collect(child, visible);
+    }
+};
+#endif
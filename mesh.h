@@ -0,0 +1,121 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "gpu_memory.h"
+#include "mesh_format.h"
+
+// Vertex attribute locations of the compiled mesh format
+const unsigned int MESH_POSITION_ATTRIB = 0;
+const unsigned int MESH_UV_ATTRIB = 2;
+const unsigned int MESH_NORMAL_ATTRIB = 3;
+
+// An indexed mesh compiled by tools/meshc. The file's vertex and index blocks are uploaded as-is
+// into ranges of a GpuHeap, the quantized attributes are expanded by the vertex fetch hardware.
+class Mesh
+{
+public:
+    GpuAllocation Vertices;
+    GpuAllocation Indices;
+    GLsizei IndexCount = 0;
+    GLenum IndexType = GL_UNSIGNED_SHORT;
+    glm::vec3 BoundsMin = glm::vec3(0.0f);
+    glm::vec3 BoundsMax = glm::vec3(0.0f);
+
+    bool load(const char* path, GpuHeap& heap)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::MESH::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return loadFromMemory(data.data(), data.size(), path, heap);
+    }
+
+    // the mesh file's bytes, e.g. read from disk or mapped from an archive
+    bool loadFromMemory(const char* data, size_t size, const char* name, GpuHeap& heap)
+    {
+        MeshFileHeader header;
+        if (size < sizeof header)
+        {
+            std::cout << "ERROR::MESH::TRUNCATED: " << name << std::endl;
+            return false;
+        }
+        memcpy(&header, data, sizeof header);
+        if (memcmp(header.magic, MESH_FILE_MAGIC, sizeof header.magic) != 0 || header.version != MESH_FILE_VERSION ||
+            header.vertexStride != sizeof(PackedVertex) || (header.indexSize != 2 && header.indexSize != 4))
+        {
+            std::cout << "ERROR::MESH::UNSUPPORTED_FORMAT: " << name << " (recompile it with tools/meshc)" << std::endl;
+            return false;
+        }
+        size_t vertexBytes = (size_t)header.vertexCount * header.vertexStride;
+        size_t indexBytes = (size_t)header.indexCount * header.indexSize;
+        if (header.vertexOffset + vertexBytes > size || header.indexOffset + indexBytes > size)
+        {
+            std::cout << "ERROR::MESH::TRUNCATED: " << name << std::endl;
+            return false;
+        }
+
+        IndexCount = (GLsizei)header.indexCount;
+        IndexType = header.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        BoundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+        BoundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+        this->heap = &heap;
+        Vertices = heap.allocate(vertexBytes);
+        Indices = heap.allocate(indexBytes);
+        if (Vertices.buffer == 0 || Indices.buffer == 0)
+            return false;
+        heap.write(Vertices, 0, data + header.vertexOffset, vertexBytes);
+        heap.write(Indices, 0, data + header.indexOffset, indexBytes);
+        return true;
+    }
+
+    // sets up the per-vertex attributes and the index buffer of a VAO
+    void attach(unsigned int vao)
+    {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, Vertices.buffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Indices.buffer);
+
+        // Vertex attribute 0 - Position
+        glEnableVertexAttribArray(MESH_POSITION_ATTRIB);
+        glVertexAttribPointer(MESH_POSITION_ATTRIB, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)(Vertices.offset + offsetof(PackedVertex, position)));
+
+        // Vertex attribute 2 - UV coordinate, half floats
+        glEnableVertexAttribArray(MESH_UV_ATTRIB);
+        glVertexAttribPointer(MESH_UV_ATTRIB, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)(Vertices.offset + offsetof(PackedVertex, uv)));
+
+        // Vertex attribute 3 - Normal vectors, signed normalized 10_10_10_2
+        glEnableVertexAttribArray(MESH_NORMAL_ATTRIB);
+        glVertexAttribPointer(MESH_NORMAL_ATTRIB, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)(Vertices.offset + offsetof(PackedVertex, normal)));
+    }
+
+    void draw(GLsizei instanceCount) const
+    {
+        glDrawElementsInstanced(GL_TRIANGLES, IndexCount, IndexType, (void*)Indices.offset, instanceCount);
+    }
+
+    void destroy()
+    {
+        if (heap == NULL)
+            return;
+        heap->free(Vertices);
+        heap->free(Indices);
+    }
+
+private:
+    GpuHeap* heap = NULL;
+};
+#endif
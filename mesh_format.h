@@ -0,0 +1,92 @@
+#ifndef MESH_FORMAT_H
+#define MESH_FORMAT_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Binary mesh file written by tools/meshc and loaded by Mesh (mesh.h).
+//
+//   MeshFileHeader
+//   PackedVertex[vertexCount]            at vertexOffset
+//   uint16_t or uint32_t[indexCount]     at indexOffset (indexSize bytes each)
+//
+// All values are little-endian. Vertices are deduplicated, indexed and ordered for the
+// post-transform vertex cache; attributes are quantized to 20 bytes per vertex.
+
+const char MESH_FILE_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+const uint32_t MESH_FILE_VERSION = 1;
+
+struct MeshFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;         // 2 or 4
+    uint32_t vertexStride;      // sizeof(PackedVertex)
+    uint32_t vertexOffset;
+    uint32_t indexOffset;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+// position: 3 x float, uv: 2 x half float, normal: signed normalized 10_10_10_2 (GL_INT_2_10_10_10_REV)
+struct PackedVertex
+{
+    float position[3];
+    uint16_t uv[2];
+    uint32_t normal;
+};
+
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must stay tightly packed");
+
+// IEEE 754 single to half precision, round to nearest even
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    if (((bits >> 23) & 0xffu) == 0xffu)
+        return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));   // inf / nan
+    if (exponent >= 31)
+        return (uint16_t)(sign | 0x7c00u);                              // overflow to inf
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+            return (uint16_t)sign;                                      // underflow to zero
+        // subnormal half
+        mantissa |= 0x800000u;
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+            half++;
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        half++;     // may carry into the exponent, which is still the correctly rounded result
+    return (uint16_t)half;
+}
+
+// packs a unit vector into 10 bits per component (signed normalized), w = 0
+inline uint32_t packNormal(float x, float y, float z)
+{
+    float components[3] = { x, y, z };
+    uint32_t packed = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        float c = components[i] < -1.0f ? -1.0f : (components[i] > 1.0f ? 1.0f : components[i]);
+        int32_t q = (int32_t)std::lround(c * 511.0f);
+        packed |= ((uint32_t)q & 0x3ffu) << (10 * i);
+    }
+    return packed;
+}
+#endif
@@ -0,0 +1,348 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_CULLER_SSE 1
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+#include "scene_graph.h"
+#include "job_system.h"
+
+// Software occlusion culling. A few large occluders (boxes of scene nodes) are rasterized on the CPU
+// into a small depth buffer, four pixels at a time, and reduced into a hierarchical-Z pyramid whose
+// texels hold the farthest depth below them. An object is occluded if the nearest point of its
+// bounding box lies behind the farthest occluder depth everywhere its screen rectangle covers; the
+// pyramid level is picked so that is at most 2x2 texels.
+//
+// The rasterization only ever errs towards "visible": a pixel is written only if the occluder covers
+// all of it, with the farthest depth the occluder has inside the pixel, and boxes that reach behind
+// the near plane are never rejected. The buffer is split into bands of rows rasterized in parallel.
+class OcclusionCuller
+{
+public:
+    enum { MAX_POLYGON_EDGES = 8, PARALLEL_TEST_MIN = 512, TEST_CHUNK = 256 };
+
+    // the buffer is width pixels wide and has the viewport's aspect ratio; jobs may be null
+    void create(int width, int viewportWidth, int viewportHeight, JobSystem* jobs)
+    {
+        Width = (width + 3) & ~3;
+        Height = std::max(1, (int)std::lround((double)Width * viewportHeight / viewportWidth));
+        workers = jobs;
+
+        levels.clear();
+        int w = Width, h = Height;
+        for (;;)
+        {
+            levels.push_back(Level(w, h));
+            if (w == 1 && h == 1)
+                break;
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+    }
+
+    // nodes whose (mesh bounds) box hides what is behind it; the bounds are in the nodes' object space
+    void setOccluders(const std::vector<int>& nodes, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        occluders = nodes;
+        occluderMin = boundsMin;
+        occluderMax = boundsMax;
+    }
+
+    // rasterizes the occluders as seen through viewProjection and rebuilds the pyramid
+    void render(const SceneGraph& scene, const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        polygons.clear();
+        for (int id : occluders)
+            addBox(scene.World[id]);
+
+        int bands = workers != NULL ? std::min(workers->size() + 1, std::max(1, Height / 16)) : 1;
+        int bandHeight = (Height + bands - 1) / bands;
+        if (bands > 1)
+            workers->parallelFor(bands, [this, bandHeight](int band) { rasterizeRows(band * bandHeight, std::min(Height, (band + 1) * bandHeight)); });
+        else
+            rasterizeRows(0, Height);
+        buildPyramid();
+    }
+
+    // whether any part of the box may be visible
+    bool isVisible(const glm::vec3& center, const glm::vec3& extent) const
+    {
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1e30f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 offset(corner & 1 ? extent.x : -extent.x, corner & 2 ? extent.y : -extent.y, corner & 4 ? extent.z : -extent.z);
+            glm::vec4 clip = viewProjection * glm::vec4(center + offset, 1.0f);
+            // reaches behind the near plane: the projected rectangle means nothing
+            if (clip.z < -clip.w || clip.w <= 0.0f)
+                return true;
+            glm::vec3 window = toWindow(clip);
+            minX = std::min(minX, window.x);
+            maxX = std::max(maxX, window.x);
+            minY = std::min(minY, window.y);
+            maxY = std::max(maxY, window.y);
+            nearest = std::min(nearest, window.z);
+        }
+
+        int x0 = std::max(0, (int)std::floor(minX)), x1 = std::min(Width - 1, (int)std::floor(maxX));
+        int y0 = std::max(0, (int)std::floor(minY)), y1 = std::min(Height - 1, (int)std::floor(maxY));
+        if (x0 > x1 || y0 > y1)
+            return true;    // off screen, the frustum test decides
+
+        int level = 0;
+        while ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)
+            level++;
+        const Level& hiz = levels[level];
+        float farthest = 0.0f;
+        for (int y = y0 >> level; y <= (y1 >> level); y++)
+            for (int x = x0 >> level; x <= (x1 >> level); x++)
+                farthest = std::max(farthest, hiz.depth[y * hiz.width + x]);
+        return nearest <= farthest;
+    }
+
+    // removes the occluded ids from visible, keeping the order of the rest; returns how many were removed
+    unsigned int cull(const SceneGraph& scene, std::vector<int>& visible)
+    {
+        // room for every node the first time, so a growing visible set never reallocates the flags
+        if (keep.capacity() < scene.size())
+            keep.reserve(scene.size());
+        int count = (int)visible.size();
+        keep.assign(count, 1);
+        if (workers != NULL && count >= PARALLEL_TEST_MIN)
+        {
+            workers->parallelFor((count + TEST_CHUNK - 1) / TEST_CHUNK, [this, &scene, &visible, count](int chunk) {
+                for (int i = chunk * TEST_CHUNK; i < std::min(count, (chunk + 1) * TEST_CHUNK); i++)
+                    keep[i] = isVisible(scene.WorldCenter[visible[i]], scene.WorldExtent[visible[i]]);
+            });
+        }
+        else
+        {
+            for (int i = 0; i < count; i++)
+                keep[i] = isVisible(scene.WorldCenter[visible[i]], scene.WorldExtent[visible[i]]);
+        }
+
+        int kept = 0;
+        for (int i = 0; i < count; i++)
+            if (keep[i])
+                visible[kept++] = visible[i];
+        visible.resize(kept);
+        return (unsigned int)(count - kept);
+    }
+
+    int Width = 0;
+    int Height = 0;
+
+private:
+    struct Level
+    {
+        int width;
+        int height;
+        std::vector<float> depth;       // window-space depth in [0, 1], 1 where nothing was drawn
+
+        Level(int width, int height) : width(width), height(height), depth((size_t)width * height, 1.0f) {}
+    };
+
+    // a convex screen-space polygon: a pixel is covered if every edge function is >= 0 at its center,
+    // with the offsets already folded in that make that mean "covered entirely"
+    struct Polygon
+    {
+        int edgeCount;
+        float edgeA[MAX_POLYGON_EDGES], edgeB[MAX_POLYGON_EDGES], edgeC[MAX_POLYGON_EDGES];
+        float depthA, depthB, depthC;   // depth = A x + B y + C, biased to the farthest value in the pixel
+        int minX, maxX, minY, maxY;
+    };
+
+    JobSystem* workers = NULL;
+    std::vector<int> occluders;
+    glm::vec3 occluderMin, occluderMax;
+    glm::mat4 viewProjection;
+    std::vector<Polygon> polygons;
+    std::vector<Level> levels;
+    std::vector<unsigned char> keep;
+
+    glm::vec3 toWindow(const glm::vec4& clip) const
+    {
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        return glm::vec3((ndc.x * 0.5f + 0.5f) * Width, (ndc.y * 0.5f + 0.5f) * Height, ndc.z * 0.5f + 0.5f);
+    }
+
+    // the six faces of the transformed box, clipped against the near plane
+    void addBox(const glm::mat4& world)
+    {
+        static const int faces[6][4] = { { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
+        glm::mat4 transform = viewProjection * world;
+        glm::vec4 corners[8];
+        for (int corner = 0; corner < 8; corner++)
+            corners[corner] = transform * glm::vec4(corner & 1 ? occluderMax.x : occluderMin.x, corner & 2 ? occluderMax.y : occluderMin.y,
+                                                    corner & 4 ? occluderMax.z : occluderMin.z, 1.0f);
+
+        for (const int* face : faces)
+        {
+            // Sutherland-Hodgman against z >= -w; a quad gains at most one vertex
+            glm::vec4 clipped[MAX_POLYGON_EDGES];
+            int count = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                const glm::vec4& a = corners[face[i]];
+                const glm::vec4& b = corners[face[(i + 1) % 4]];
+                float da = a.z + a.w, db = b.z + b.w;
+                if (da >= 0.0f)
+                    clipped[count++] = a;
+                if ((da >= 0.0f) != (db >= 0.0f))
+                    clipped[count++] = a + (b - a) * (da / (da - db));
+            }
+            if (count >= 3)
+                addPolygon(clipped, count);
+        }
+    }
+
+    void addPolygon(const glm::vec4* clip, int count)
+    {
+        glm::vec3 window[MAX_POLYGON_EDGES];
+        for (int i = 0; i < count; i++)
+        {
+            // points exactly on the near plane of a perspective projection still have w > 0
+            if (clip[i].w <= 0.0f)
+                return;
+            window[i] = toWindow(clip[i]);
+        }
+
+        // twice the signed area gives the winding; both windings are drawn, back faces simply lose the depth test
+        float area = 0.0f;
+        float minX = window[0].x, maxX = minX, minY = window[0].y, maxY = minY;
+        for (int i = 0; i < count; i++)
+        {
+            const glm::vec3& a = window[i];
+            const glm::vec3& b = window[(i + 1) % count];
+            area += a.x * b.y - b.x * a.y;
+            minX = std::min(minX, b.x);
+            maxX = std::max(maxX, b.x);
+            minY = std::min(minY, b.y);
+            maxY = std::max(maxY, b.y);
+        }
+        if (std::fabs(area) < 1e-6f)
+            return;
+
+        Polygon polygon;
+        polygon.minX = std::max(0, (int)std::floor(minX));
+        polygon.maxX = std::min(Width - 1, (int)std::ceil(maxX));
+        polygon.minY = std::max(0, (int)std::floor(minY));
+        polygon.maxY = std::min(Height - 1, (int)std::ceil(maxY));
+        if (polygon.minX > polygon.maxX || polygon.minY > polygon.maxY)
+            return;
+
+        float sign = area > 0.0f ? 1.0f : -1.0f;
+        polygon.edgeCount = count;
+        for (int i = 0; i < count; i++)
+        {
+            const glm::vec3& a = window[i];
+            const glm::vec3& b = window[(i + 1) % count];
+            float edgeA = sign * (a.y - b.y);
+            float edgeB = sign * (b.x - a.x);
+            // evaluated at the pixel center, the edge must clear the farthest corner of the pixel
+            polygon.edgeA[i] = edgeA;
+            polygon.edgeB[i] = edgeB;
+            polygon.edgeC[i] = -(edgeA * a.x + edgeB * a.y) - 0.5f * (std::fabs(edgeA) + std::fabs(edgeB));
+        }
+
+        // the depth plane through the fan triangle with the largest area (the polygon is planar)
+        int best = 1;
+        float bestArea = 0.0f;
+        for (int i = 1; i + 1 < count; i++)
+        {
+            glm::vec3 e1 = window[i] - window[0], e2 = window[i + 1] - window[0];
+            float triangleArea = std::fabs(e1.x * e2.y - e2.x * e1.y);
+            if (triangleArea > bestArea)
+            {
+                bestArea = triangleArea;
+                best = i;
+            }
+        }
+        glm::vec3 e1 = window[best] - window[0], e2 = window[best + 1] - window[0];
+        float determinant = e1.x * e2.y - e2.x * e1.y;
+        if (std::fabs(determinant) < 1e-6f)
+            return;
+        polygon.depthA = (e1.z * e2.y - e2.z * e1.y) / determinant;
+        polygon.depthB = (e2.z * e1.x - e1.z * e2.x) / determinant;
+        polygon.depthC = window[0].z - polygon.depthA * window[0].x - polygon.depthB * window[0].y +
+                         0.5f * (std::fabs(polygon.depthA) + std::fabs(polygon.depthB));
+        polygons.push_back(polygon);
+    }
+
+    // clears and rasterizes rows [y0, y1) of level 0
+    void rasterizeRows(int y0, int y1)
+    {
+        float* depth = levels[0].depth.data();
+        std::fill(depth + (size_t)y0 * Width, depth + (size_t)y1 * Width, 1.0f);
+        for (const Polygon& polygon : polygons)
+        {
+            int rowStart = std::max(y0, polygon.minY), rowEnd = std::min(y1 - 1, polygon.maxY);
+            int xStart = polygon.minX & ~3;
+            for (int y = rowStart; y <= rowEnd; y++)
+            {
+                float py = y + 0.5f;
+                float* row = depth + (size_t)y * Width;
+#if defined(OCCLUSION_CULLER_SSE)
+                __m128 rowDepth = _mm_set1_ps(polygon.depthB * py + polygon.depthC);
+                __m128 depthA = _mm_set1_ps(polygon.depthA);
+                __m128 zero = _mm_setzero_ps();
+                for (int x = xStart; x <= polygon.maxX; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+                    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    for (int e = 0; e < polygon.edgeCount; e++)
+                    {
+                        __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(polygon.edgeA[e]), px), _mm_set1_ps(polygon.edgeB[e] * py + polygon.edgeC[e]));
+                        inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, zero));
+                    }
+                    if (_mm_movemask_ps(inside) == 0)
+                        continue;
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 z = _mm_min_ps(old, _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth));
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, z), _mm_andnot_ps(inside, old)));
+                }
+#else
+                for (int x = xStart; x <= polygon.maxX; x++)
+                {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for (int e = 0; e < polygon.edgeCount && inside; e++)
+                        inside = polygon.edgeA[e] * px + polygon.edgeB[e] * py + polygon.edgeC[e] >= 0.0f;
+                    if (inside)
+                        row[x] = std::min(row[x], polygon.depthA * px + polygon.depthB * py + polygon.depthC);
+                }
+#endif
+            }
+        }
+    }
+
+    // every texel of a level is the farthest of the (up to) 2x2 texels below it
+    void buildPyramid()
+    {
+        for (size_t l = 1; l < levels.size(); l++)
+        {
+            const Level& below = levels[l - 1];
+            Level& level = levels[l];
+            for (int y = 0; y < level.height; y++)
+            {
+                int y0 = 2 * y, y1 = std::min(2 * y + 1, below.height - 1);
+                for (int x = 0; x < level.width; x++)
+                {
+                    int x0 = 2 * x, x1 = std::min(2 * x + 1, below.width - 1);
+                    level.depth[y * level.width + x] = std::max(std::max(below.depth[y0 * below.width + x0], below.depth[y0 * below.width + x1]),
+                                                                std::max(below.depth[y1 * below.width + x0], below.depth[y1 * below.width + x1]));
+                }
+            }
+        }
+    }
+};
+#endif
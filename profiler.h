@@ -0,0 +1,258 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Built-in CPU and GPU profiler, compiled in only when PROFILING is defined (e.g. -DPROFILING);
+// otherwise every PROFILE_ macro expands to nothing and this header declares nothing.
+//
+//   PROFILE_ZONE("name")       times the rest of the enclosing scope on the calling thread
+//   PROFILE_GPU_ZONE("name")   the same for the GL commands issued in the scope (GL thread only)
+//   PROFILE_THREAD("name")     names the calling thread in the trace
+//
+// Zone names must be string literals (only the pointer is kept). Between Profiler::start() and stop()
+// every thread appends finished zones to its own fixed-size buffer: the owner is the only writer and
+// publishes each event with a release store of the count, so recording takes no lock. GPU zones are a
+// pair of GL_TIMESTAMP queries taken from a ring and read back frames later, once available, so
+// they never stall the pipeline; timestamps rather than GL_TIME_ELAPSED because they may overlap
+// the benchmark's GpuTimer ranges and place the zone on the trace's timeline. writeTrace() exports
+// everything as Chrome trace event JSON (chrome://tracing, ui.perfetto.dev).
+#ifdef PROFILING
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Profiler
+{
+public:
+    enum { THREAD_EVENTS = 1 << 16, GPU_QUERIES = 128 };
+
+    static Profiler& get()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // starts recording; the GL context has to be current for the GPU zones
+    void start()
+    {
+        epoch = std::chrono::steady_clock::now();
+        glGenQueries(GPU_QUERIES, queries);
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        gpuOffset = (long long)gpuNow - now();
+        recording = true;
+    }
+
+    // stops recording and waits for the GPU zones still in flight
+    void stop()
+    {
+        recording = false;
+        collectGpu(true);
+        glDeleteQueries(GPU_QUERIES, queries);
+    }
+
+    bool isRecording() const
+    {
+        return recording.load(std::memory_order_relaxed);
+    }
+
+    // nanoseconds since start()
+    long long now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    void setThreadName(const char* name)
+    {
+        threadBuffer().name = name;
+    }
+
+    void record(const char* name, long long begin, long long end)
+    {
+        ThreadBuffer& buffer = threadBuffer();
+        int count = buffer.count.load(std::memory_order_relaxed);
+        if (count >= THREAD_EVENTS)
+            return;
+        buffer.events[count] = Event{ name, begin, end };
+        buffer.count.store(count + 1, std::memory_order_release);
+    }
+
+    // returns false if nothing was started, and then gpuEnd() must not be called
+    bool gpuBegin(const char* name)
+    {
+        if (!isRecording())
+            return false;
+        // the ring is full: the oldest zone has to finish before its queries can be reused
+        if (gpuIssued - gpuCollected >= GPU_QUERIES / 2)
+            collectGpu(true, 1);
+        int slot = (int)(gpuIssued % (GPU_QUERIES / 2));
+        gpuNames[slot] = name;
+        glQueryCounter(queries[2 * slot], GL_TIMESTAMP);
+        gpuOpen.push_back(gpuIssued++);
+        return true;
+    }
+
+    // ends the innermost open GPU zone
+    void gpuEnd()
+    {
+        int slot = (int)(gpuOpen.back() % (GPU_QUERIES / 2));
+        glQueryCounter(queries[2 * slot + 1], GL_TIMESTAMP);
+        gpuOpen.pop_back();
+    }
+
+    // turns the finished GPU zones into events, oldest first; with wait set also the unfinished ones
+    // (at most limit of them). Zones still open and everything after them stay in the ring.
+    void collectGpu(bool wait = false, long long limit = -1)
+    {
+        long long closed = gpuOpen.empty() ? gpuIssued : gpuOpen.front();
+        while (gpuCollected < closed && limit != 0)
+        {
+            int slot = (int)(gpuCollected % (GPU_QUERIES / 2));
+            GLint available = 0;
+            glGetQueryObjectiv(queries[2 * slot + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available && !wait)
+                return;
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(queries[2 * slot], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[2 * slot + 1], GL_QUERY_RESULT, &end);
+            gpuEvents.push_back(Event{ gpuNames[slot], (long long)begin - gpuOffset, (long long)end - gpuOffset });
+            gpuCollected++;
+            limit--;
+        }
+    }
+
+    // writes every recorded zone as Chrome trace events, one track per thread plus one for the GPU
+    bool writeTrace(const std::string& path)
+    {
+        std::ofstream out(path);
+        if (!out)
+        {
+            std::cout << "ERROR::PROFILER::WRITE_FAILED: " << path << std::endl;
+            return false;
+        }
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for (size_t t = 0; t <= threads.size(); t++)
+        {
+            bool gpu = t == threads.size();
+            int tid = gpu ? 0 : (int)t + 1;
+            std::string name = gpu ? "GPU" : threads[t]->name;
+            writeSeparator(out, first);
+            out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid << ", \"args\": {\"name\": \"" << name << "\"}}";
+            const Event* events = gpu ? gpuEvents.data() : threads[t]->events.get();
+            int count = gpu ? (int)gpuEvents.size() : threads[t]->count.load(std::memory_order_acquire);
+            for (int i = 0; i < count; i++)
+            {
+                writeSeparator(out, first);
+                out << "{\"name\": \"" << events[i].name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+                    << ", \"ts\": " << events[i].begin / 1000.0 << ", \"dur\": " << (events[i].end - events[i].begin) / 1000.0 << "}";
+            }
+        }
+        out << "\n]}" << std::endl;
+        return true;
+    }
+
+private:
+    struct Event
+    {
+        const char* name;
+        long long begin, end;   // nanoseconds since start()
+    };
+
+    // one thread's events; only the owner writes, the exporter reads the first count
+    struct ThreadBuffer
+    {
+        std::string name;
+        std::unique_ptr<Event[]> events;
+        std::atomic<int> count{ 0 };
+    };
+
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::atomic<bool> recording{ false };
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ThreadBuffer> > threads;
+
+    GLuint queries[GPU_QUERIES] = {};
+    const char* gpuNames[GPU_QUERIES / 2] = {};
+    long long gpuIssued = 0, gpuCollected = 0;
+    long long gpuOffset = 0;    // GPU timestamp minus now()
+    std::vector<long long> gpuOpen;     // zones begun but not ended, outermost first
+    std::vector<Event> gpuEvents;
+
+    // the calling thread's buffer, registered on its first zone
+    ThreadBuffer& threadBuffer()
+    {
+        static thread_local ThreadBuffer* buffer = NULL;
+        if (buffer == NULL)
+        {
+            std::lock_guard<std::mutex> lock(threadsMutex);
+            threads.emplace_back(new ThreadBuffer());
+            buffer = threads.back().get();
+            buffer->name = "thread " + std::to_string(threads.size());
+            buffer->events.reset(new Event[THREAD_EVENTS]);
+        }
+        return *buffer;
+    }
+
+    static void writeSeparator(std::ostream& out, bool& first)
+    {
+        if (!first)
+            out << ",\n";
+        first = false;
+    }
+};
+
+// times its scope on the calling thread while the profiler records
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name) : name(name), begin(Profiler::get().isRecording() ? Profiler::get().now() : -1) {}
+
+    ~ProfileZone()
+    {
+        if (begin >= 0)
+            Profiler::get().record(name, begin, Profiler::get().now());
+    }
+
+private:
+    const char* name;
+    long long begin;
+};
+
+class GpuProfileZone
+{
+public:
+    explicit GpuProfileZone(const char* name) : started(Profiler::get().gpuBegin(name)) {}
+
+    ~GpuProfileZone()
+    {
+        if (started)
+            Profiler::get().gpuEnd();
+    }
+
+private:
+    bool started;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) GpuProfileZone PROFILE_CONCAT(gpuProfileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::get().setThreadName(name)
+
+#else
+
+#define PROFILE_ZONE(name) do { } while (0)
+#define PROFILE_GPU_ZONE(name) do { } while (0)
+#define PROFILE_THREAD(name) do { } while (0)
+
+#endif
+#endif
@@ -0,0 +1,189 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+const char PROGRAM_CACHE_MAGIC[4] = { 'P', 'B', 'I', 'N' };
+
+// Program binaries need GL 4.1 or ARB_get_program_binary; without them every program is compiled
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+#define PROGRAM_CACHE_SUPPORTED 1
+#endif
+
+// Keeps linked programs on disk (glGetProgramBinary) so later starts can skip compiling and linking.
+// Entries are keyed by a hash of the shader sources, their defines and the driver (vendor, renderer,
+// version), so an edited shader or an updated driver simply misses. The driver may still reject a
+// stored binary; then the caller compiles from source and the entry is rewritten.
+//
+// File layout of <directory>/<key>.bin: ProgramCacheHeader followed by the binary.
+class ProgramCache
+{
+public:
+    unsigned int Hits = 0;
+    unsigned int Misses = 0;
+
+    // call with the context current; returns false (and caches nothing) if the driver has no binary formats
+    bool create(const std::string& directory)
+    {
+        Directory = directory;
+        enabled = false;
+#ifdef PROGRAM_CACHE_SUPPORTED
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        enabled = formats > 0 && !directory.empty();
+#endif
+        if (!enabled)
+            return false;
+
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+        driverHash = hash(FNV_OFFSET, "program-cache-1");
+        const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (GLenum name : strings)
+        {
+            const char* value = (const char*)glGetString(name);
+            driverHash = hash(driverHash, value != NULL ? value : "");
+        }
+        return true;
+    }
+
+    // identifies a program by everything that goes into its binary
+    uint64_t key(const std::vector<std::string>& sources, const std::string& defines) const
+    {
+        uint64_t h = hash(driverHash, defines);
+        for (const std::string& source : sources)
+            h = hash(h, source);
+        return h;
+    }
+
+    // call before glLinkProgram, so the driver keeps the binary around for store()
+    void prepare(GLuint program) const
+    {
+#ifdef PROGRAM_CACHE_SUPPORTED
+        if (enabled)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+    }
+
+    // links program from the stored binary; false if there is none or the driver rejects it
+    bool load(GLuint program, uint64_t key)
+    {
+#ifdef PROGRAM_CACHE_SUPPORTED
+        if (enabled)
+        {
+            std::ifstream file(path(key).c_str(), std::ios::binary);
+            ProgramCacheHeader header;
+            if (file.read((char*)&header, sizeof header) && memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof header.magic) == 0 && header.key == key)
+            {
+                std::vector<char> binary(header.length);
+                if (file.read(binary.data(), binary.size()))
+                {
+                    glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+                    GLint linked = GL_FALSE;
+                    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+                    if (linked)
+                    {
+                        Hits++;
+                        return true;
+                    }
+                }
+            }
+        }
+#endif
+        Misses++;
+        return false;
+    }
+
+    // writes the binary of a successfully linked program
+    void store(GLuint program, uint64_t key) const
+    {
+#ifdef PROGRAM_CACHE_SUPPORTED
+        if (!enabled)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        ProgramCacheHeader header;
+        memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof header.magic);
+        header.key = key;
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+        header.format = format;
+        header.length = (uint32_t)length;
+        header.reserved = 0;
+
+        // write next to the final name and rename, so a crash never leaves a truncated entry behind
+        std::string target = path(key);
+        std::string temporary = target + ".tmp";
+        {
+            std::ofstream file(temporary.c_str(), std::ios::binary);
+            if (!file)
+            {
+                std::cout << "ERROR::PROGRAM_CACHE::WRITE_FAILED: " << temporary << std::endl;
+                return;
+            }
+            file.write((const char*)&header, sizeof header);
+            file.write(binary.data(), header.length);
+        }
+        std::remove(target.c_str());
+        std::rename(temporary.c_str(), target.c_str());
+#else
+        (void)program;
+        (void)key;
+#endif
+    }
+
+private:
+    struct ProgramCacheHeader
+    {
+        char magic[4];
+        uint32_t format;        // binaryFormat reported by glGetProgramBinary
+        uint64_t key;
+        uint32_t length;
+        uint32_t reserved;
+    };
+
+    static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+    std::string Directory;
+    bool enabled = false;
+    uint64_t driverHash = 0;
+
+    // 64-bit FNV-1a, continued from h; the length goes in too so concatenations cannot collide
+    static uint64_t hash(uint64_t h, const std::string& data)
+    {
+        uint64_t length = data.size();
+        for (int i = 0; i < 8; i++)
+            h = (h ^ ((length >> (8 * i)) & 0xff)) * 1099511628211ull;
+        for (unsigned char c : data)
+            h = (h ^ c) * 1099511628211ull;
+        return h;
+    }
+
+    std::string path(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof name, "%016llx.bin", (unsigned long long)key);
+        return Directory + "/" + name;
+    }
+};
+#endif
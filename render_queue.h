@@ -0,0 +1,97 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "frame_arena.h"
+#include "gl_state_cache.h"
+#include "mesh.h"
+#include "profiler.h"
+
+// One instanced draw of a mesh with the program, texture and vertex array it needs
+struct DrawItem
+{
+    uint64_t key;
+    const char* name;           // for the profiler, a string literal
+    unsigned int program;
+    GLenum textureTarget;
+    unsigned int texture;       // bound to the queue's texture unit
+    unsigned int vertexArray;
+    const Mesh* mesh;
+    GLsizei instances;
+    unsigned int order;         // when it was added, so equal keys keep that order
+};
+
+// The draws of one pass, sorted by a 64-bit key before they are issued so that draws sharing a
+// program, then a texture, then a vertex array follow each other and the state cache can drop the
+// repeated binds; within the same state they go front to back for early depth rejection.
+//
+//   bits 63-52  program     bits 51-40  texture     bits 39-24  vertex array     bits 23-0  depth
+//
+// IDs wider than their field only weaken the grouping, the item keeps the full ones. Adding and
+// sorting touches no GL, so a queue can be built on a worker, and its items can live in a FrameArena.
+class RenderQueue
+{
+public:
+    static uint64_t makeKey(unsigned int program, unsigned int texture, unsigned int vertexArray, float depth)
+    {
+        uint64_t quantizedDepth = (uint64_t)(std::min(1.0f, std::max(0.0f, depth)) * 0xFFFFFF);
+        return (uint64_t)(program & 0xFFF) << 52 | (uint64_t)(texture & 0xFFF) << 40 | (uint64_t)(vertexArray & 0xFFFF) << 24 | quantizedDepth;
+    }
+
+    void clear()
+    {
+        items.clear();
+    }
+
+    // empties the queue into the arena of the frame it is built for
+    void reset(FrameArena& arena)
+    {
+        resetFrameVector(items, arena);
+    }
+
+    // depth is the draw's nearest view depth scaled to [0, 1]; empty draws are left out
+    void add(const char* name, unsigned int program, GLenum textureTarget, unsigned int texture, unsigned int vertexArray,
+             const Mesh& mesh, GLsizei instances, float depth)
+    {
+        if (instances <= 0)
+            return;
+        items.push_back(DrawItem{ makeKey(program, texture, vertexArray, depth), name, program, textureTarget, texture, vertexArray, &mesh, instances,
+                                  (unsigned int)items.size() });
+    }
+
+    void sort()
+    {
+        // stable, without the scratch buffer std::stable_sort would allocate
+        std::sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key || (a.key == b.key && a.order < b.order); });
+    }
+
+    // issues the draws in queue order through the state cache and returns how many there were
+    unsigned int submit(GLStateCache& state, unsigned int textureUnit) const
+    {
+        for (const DrawItem& item : items)
+        {
+            PROFILE_ZONE(item.name);
+            PROFILE_GPU_ZONE(item.name);
+            state.useProgram(item.program);
+            state.bindTexture(textureUnit, item.textureTarget, item.texture);
+            state.bindVertexArray(item.vertexArray);
+            item.mesh->draw(item.instances);
+        }
+        return (unsigned int)items.size();
+    }
+
+    size_t size() const
+    {
+        return items.size();
+    }
+
+private:
+    FrameVector<DrawItem> items;
+};
+#endif
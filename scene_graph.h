@@ -0,0 +1,199 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "transform_store.h"
+
+// Which program a node is drawn with
+enum Material {
+    MATERIAL_NONE,      // grouping node, not drawn
+    MATERIAL_LIT,       // lightingShader, the lit variant of main.vsh/main.fsh
+    MATERIAL_EMISSIVE   // lightCubeShader, the emissive variant
+};
+
+// A flat scene graph. Node data is stored in parallel arrays indexed by node id, and a node's
+// parent always has a smaller id than the node itself, so parents are processed before their children.
+// World matrices are cached: only nodes whose transform was changed since the last update() (and
+// their descendants) are recomputed, so static geometry costs nothing per frame. Local matrices and
+// normal matrices are composed in batches by the SIMD kernels of TransformStore.
+// Drawn nodes also get a world-space bounding box from the bounds of their mesh (setMeshBounds).
+class SceneGraph
+{
+public:
+    enum { NO_PARENT = -1 };
+
+    // per-node data
+    std::vector<int> Parent;
+    std::vector<int> FirstChild;
+    std::vector<int> NextSibling;
+    TransformStore Transforms;
+    std::vector<glm::mat4> Local;
+    std::vector<glm::mat4> World;
+    std::vector<glm::mat3> LocalNormal;
+    std::vector<glm::mat3> WorldNormal;     // inverse transpose of World's upper 3x3
+    std::vector<int> Mesh;
+    std::vector<int> Texture;
+    std::vector<Material> NodeMaterial;
+    std::vector<glm::vec3> WorldCenter;     // world-space axis-aligned bounding box of drawn nodes
+    std::vector<glm::vec3> WorldExtent;     // (center and half size)
+
+    // nodes whose world matrix was recomputed by the last update(), in ascending order
+    std::vector<int> Changed;
+
+    int addNode(int parent, glm::vec3 position, glm::vec3 scale, int texture = 0, Material material = MATERIAL_LIT, int mesh = 0)
+    {
+        int id = (int)Parent.size();
+        Parent.push_back(parent);
+        FirstChild.push_back(NO_PARENT);
+        NextSibling.push_back(NO_PARENT);
+        Transforms.add(position, scale);
+        Local.push_back(glm::mat4(1.0f));
+        World.push_back(glm::mat4(1.0f));
+        LocalNormal.push_back(glm::mat3(1.0f));
+        WorldNormal.push_back(glm::mat3(1.0f));
+        Mesh.push_back(mesh);
+        Texture.push_back(texture);
+        NodeMaterial.push_back(material);
+        WorldCenter.push_back(glm::vec3(0.0f));
+        WorldExtent.push_back(glm::vec3(0.0f));
+        dirtyFlag.push_back(false);
+        updateStamp.push_back(0);
+
+        if (parent != NO_PARENT)
+        {
+            NextSibling[id] = FirstChild[parent];
+            FirstChild[parent] = id;
+        }
+        markDirty(id);
+        return id;
+    }
+
+    // convenience for nodes that only group their children
+    int addGroup(int parent, glm::vec3 position = glm::vec3(0.0f))
+    {
+        return addNode(parent, position, glm::vec3(1.0f), 0, MATERIAL_NONE);
+    }
+
+    void setPosition(int id, const glm::vec3& position)
+    {
+        Transforms.setPosition(id, position);
+        markDirty(id);
+    }
+
+    void setRotation(int id, float angle, const glm::vec3& axis)
+    {
+        Transforms.setRotation(id, angle, axis);
+        markDirty(id);
+    }
+
+    void setScale(int id, const glm::vec3& scale)
+    {
+        Transforms.setScale(id, scale);
+        markDirty(id);
+    }
+
+    // object-space bounds of a mesh id, used for every node drawn with it; set before the nodes are updated
+    void setMeshBounds(int mesh, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        if (mesh >= (int)meshCenter.size())
+        {
+            meshCenter.resize(mesh + 1, glm::vec3(0.0f));
+            meshExtent.resize(mesh + 1, glm::vec3(0.0f));
+        }
+        meshCenter[mesh] = (boundsMin + boundsMax) * 0.5f;
+        meshExtent[mesh] = (boundsMax - boundsMin) * 0.5f;
+    }
+
+    bool isDrawn(int id) const
+    {
+        return NodeMaterial[id] != MATERIAL_NONE;
+    }
+
+    size_t size() const
+    {
+        return Parent.size();
+    }
+
+    // recomputes the local matrices of every dirty node and the world matrix of it and its descendants
+    void update()
+    {
+        Changed.clear();
+        if (dirty.empty())
+            return;
+
+        stamp++;
+        std::sort(dirty.begin(), dirty.end());
+        Transforms.compose(dirty.data(), dirty.size(), Local.data(), LocalNormal.data());
+        for (int id : dirty)
+            dirtyFlag[id] = false;
+        for (int id : dirty)
+        {
+            // an ancestor that was also dirty has already refreshed this whole subtree
+            if (updateStamp[id] != stamp)
+                updateSubtree(id);
+        }
+        dirty.clear();
+        std::sort(Changed.begin(), Changed.end());
+    }
+
+private:
+    std::vector<bool> dirtyFlag;
+    std::vector<unsigned int> updateStamp;
+    std::vector<int> dirty;
+    std::vector<int> stack;
+    unsigned int stamp = 0;
+    std::vector<glm::vec3> meshCenter;
+    std::vector<glm::vec3> meshExtent;
+
+    void markDirty(int id)
+    {
+        if (!dirtyFlag[id])
+        {
+            dirtyFlag[id] = true;
+            dirty.push_back(id);
+        }
+    }
+
+    void updateSubtree(int root)
+    {
+        stack.clear();
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            int id = stack.back();
+            stack.pop_back();
+
+            int parent = Parent[id];
+            if (parent == NO_PARENT)
+            {
+                World[id] = Local[id];
+                WorldNormal[id] = LocalNormal[id];
+            }
+            else
+            {
+                // (A B)^-T = A^-T B^-T, so normal matrices chain like the model matrices do
+                World[id] = World[parent] * Local[id];
+                WorldNormal[id] = WorldNormal[parent] * LocalNormal[id];
+            }
+            if (isDrawn(id) && Mesh[id] < (int)meshCenter.size())
+            {
+                // transformed box of the mesh bounds: the extent along each world axis is |M| * extent
+                const glm::mat4& world = World[id];
+                glm::mat3 absolute(glm::abs(glm::vec3(world[0])), glm::abs(glm::vec3(world[1])), glm::abs(glm::vec3(world[2])));
+                WorldCenter[id] = glm::vec3(world * glm::vec4(meshCenter[Mesh[id]], 1.0f));
+                WorldExtent[id] = absolute * meshExtent[Mesh[id]];
+            }
+            updateStamp[id] = stamp;
+            Changed.push_back(id);
+
+            for (int child = FirstChild[id]; child != NO_PARENT; child = NextSibling[child])
+                stack.push_back(child);
+        }
+    }
+};
+#endif
@@ -10,58 +10,68 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+
+#include "profiler.h"
+#include "program_cache.h"
+
+// the source code of a program's stages; an empty geometry stage is left out, and a compute
+// program has nothing but its compute stage
+struct ShaderSources
+{
+    std::string vertex;
+    std::string fragment;
+    std::string geometry;
+    std::string compute;
+};
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly; with a cache, a binary linked on an earlier run is reused.
+    // defines (e.g. "#define FEATURE\n") are inserted after the #version line of every stage
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, ProgramCache* cache = nullptr,
+           const std::string& defines = "")
+        : Shader(readSources(vertexPath, fragmentPath, geometryPath), cache, defines)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
+    }
+    // the same from sources already in memory, e.g. entries of an AssetPack
+    // ------------------------------------------------------------------------
+    Shader(const ShaderSources& sources, ProgramCache* cache = nullptr, const std::string& defines = "")
+    {
+        PROFILE_ZONE("build shader");
+        if (!sources.compute.empty())
         {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
+            buildCompute(sources.compute, cache, defines);
+            return;
         }
-        catch (std::ifstream::failure& e)
+        // 1. insert the defines
+        bool hasGeometry = !sources.geometry.empty();
+        std::string vertexCode = injectDefines(sources.vertex, defines);
+        std::string fragmentCode = injectDefines(sources.fragment, defines);
+        std::string geometryCode = hasGeometry ? injectDefines(sources.geometry, defines) : std::string();
+        // 2. try the program cache
+        ID = glCreateProgram();
+        uint64_t cacheKey = 0;
+        if (cache != nullptr)
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            std::vector<std::string> stages;
+            stages.push_back(vertexCode);
+            stages.push_back(fragmentCode);
+            stages.push_back(geometryCode);
+            cacheKey = cache->key(stages, defines);
+            if (cache->load(ID, cacheKey))
+            {
+                cacheUniformLocations();
+                return;
+            }
         }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 3. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -74,8 +84,8 @@ public:
         glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
+        unsigned int geometry = 0;
+        if(hasGeometry)
         {
             const char * gShaderCode = geometryCode.c_str();
             geometry = glCreateShader(GL_GEOMETRY_SHADER);
@@ -84,89 +94,272 @@ public:
             checkCompileErrors(geometry, "GEOMETRY");
         }
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
+        if(hasGeometry)
             glAttachShader(ID, geometry);
+        if (cache != nullptr)
+            cache->prepare(ID);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        if (checkCompileErrors(ID, "PROGRAM") && cache != nullptr)
+            cache->store(ID, cacheKey);
+        // resolve every uniform location once, so setting uniforms never has to ask the driver
+        cacheUniformLocations();
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
-        if(geometryPath != nullptr)
+        if(hasGeometry)
             glDeleteShader(geometry);
 
     }
+    // reads the stages from files; the geometry stage only if geometryPath is given
+    // ------------------------------------------------------------------------
+    static ShaderSources readSources(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    {
+        ShaderSources sources;
+        std::ifstream vShaderFile;
+        std::ifstream fShaderFile;
+        std::ifstream gShaderFile;
+        // ensure ifstream objects can throw exceptions:
+        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        try 
+        {
+            // open files
+            vShaderFile.open(vertexPath);
+            fShaderFile.open(fragmentPath);
+            std::stringstream vShaderStream, fShaderStream;
+            // read file's buffer contents into streams
+            vShaderStream << vShaderFile.rdbuf();
+            fShaderStream << fShaderFile.rdbuf();		
+            // close file handlers
+            vShaderFile.close();
+            fShaderFile.close();
+            // convert stream into string
+            sources.vertex = vShaderStream.str();
+            sources.fragment = fShaderStream.str();			
+            // if geometry shader path is present, also load a geometry shader
+            if(geometryPath != nullptr)
+            {
+                gShaderFile.open(geometryPath);
+                std::stringstream gShaderStream;
+                gShaderStream << gShaderFile.rdbuf();
+                gShaderFile.close();
+                sources.geometry = gShaderStream.str();
+            }
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+        }
+        return sources;
+    }
+    // reads a compute program's only stage from a file
+    // ------------------------------------------------------------------------
+    static ShaderSources readComputeSource(const char* computePath)
+    {
+        ShaderSources sources;
+        std::ifstream cShaderFile(computePath);
+        if (!cShaderFile)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            return sources;
+        }
+        std::stringstream cShaderStream;
+        cShaderStream << cShaderFile.rdbuf();
+        sources.compute = cShaderStream.str();
+        return sources;
+    }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
     { 
         glUseProgram(ID); 
     }
+    // returns the location resolved at link time, or -1 if the program has no active uniform of that name
+    // ------------------------------------------------------------------------
+    GLint getUniformLocation(const std::string &name) const
+    {
+        std::unordered_map<std::string, GLint>::const_iterator it = uniformLocations.find(name);
+        return it != uniformLocations.end() ? it->second : -1;
+    }
+    // connects a uniform block of this program to a buffer binding point
+    // ------------------------------------------------------------------------
+    void bindUniformBlock(const char* blockName, unsigned int bindingPoint) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, blockName);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, bindingPoint);
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(getUniformLocation(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(getUniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(getUniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(getUniformLocation(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(getUniformLocation(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(getUniformLocation(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(getUniformLocation(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(getUniformLocation(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(getUniformLocation(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
+    }
+
+    // uniform functions taking a location from getUniformLocation(), for the per-frame hot path
+    // ------------------------------------------------------------------------
+    void setInt(GLint location, int value) const
+    {
+        glUniform1i(location, value);
+    }
+    // ------------------------------------------------------------------------
+    void setFloat(GLint location, float value) const
+    {
+        glUniform1f(location, value);
+    }
+    // ------------------------------------------------------------------------
+    void setVec3(GLint location, const glm::vec3 &value) const
+    {
+        glUniform3fv(location, 1, &value[0]);
+    }
+    // ------------------------------------------------------------------------
+    void setVec4(GLint location, const glm::vec4 &value) const
+    {
+        glUniform4fv(location, 1, &value[0]);
+    }
+    // ------------------------------------------------------------------------
+    void setMat4(GLint location, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
-    // utility function for checking shader compilation/linking errors.
+    std::unordered_map<std::string, GLint> uniformLocations;
+
+    // the compute program counterpart of the constructor
+    // ------------------------------------------------------------------------
+    void buildCompute(const std::string& source, ProgramCache* cache, const std::string& defines)
+    {
+        std::string computeCode = injectDefines(source, defines);
+        ID = glCreateProgram();
+        uint64_t cacheKey = 0;
+        if (cache != nullptr)
+        {
+            cacheKey = cache->key(std::vector<std::string>(1, computeCode), defines);
+            if (cache->load(ID, cacheKey))
+            {
+                cacheUniformLocations();
+                return;
+            }
+        }
+#ifdef GL_COMPUTE_SHADER
+        const char* cShaderCode = computeCode.c_str();
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE");
+        glAttachShader(ID, compute);
+        if (cache != nullptr)
+            cache->prepare(ID);
+        glLinkProgram(ID);
+        if (checkCompileErrors(ID, "PROGRAM") && cache != nullptr)
+            cache->store(ID, cacheKey);
+        cacheUniformLocations();
+        glDeleteShader(compute);
+#else
+        std::cout << "ERROR::SHADER::COMPUTE_NOT_SUPPORTED" << std::endl;
+#endif
+    }
+
+    // queries the location of every active uniform of the linked program
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, &name[0]);
+            std::string uniformName(name.c_str(), length);
+            // members of uniform blocks have no location
+            GLint location = glGetUniformLocation(ID, uniformName.c_str());
+            if (location < 0)
+                continue;
+            uniformLocations[uniformName] = location;
+            // arrays are reported as "name[0]"; make them reachable as "name" too
+            std::string::size_type bracket = uniformName.find('[');
+            if (bracket != std::string::npos)
+                uniformLocations[uniformName.substr(0, bracket)] = location;
+        }
+    }
+
+    // inserts defines after the #version line, which has to stay the first statement of the source
+    // ------------------------------------------------------------------------
+    static std::string injectDefines(const std::string& source, const std::string& defines)
+    {
+        if (defines.empty())
+            return source;
+        std::string::size_type version = source.find("#version");
+        std::string::size_type lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return defines + source;
+        return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+    }
+
+    // utility function for checking shader compilation/linking errors; returns true on success
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -188,6 +381,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
@@ -0,0 +1,129 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <learnopenggl/shader_m.h>
+
+#include "program_cache.h"
+
+// Compile-time features of a shader variant; each one is a #define of the same name
+enum ShaderFeature
+{
+    SHADER_TEXTURED = 1 << 0,           // the surface color comes from the texture array
+    SHADER_SPECULAR = 1 << 1,           // specular highlights on top of diffuse lighting
+    SHADER_EMISSIVE = 1 << 2,           // unlit, glows in the light's color
+    SHADER_CLUSTERED_LIGHTS = 1 << 3,   // the point lights of the fragment's light cluster
+    SHADER_SHADOWS = 1 << 4,            // shadow-casting lights from the shadow atlas
+};
+
+const char* const SHADER_FEATURE_NAMES[] = { "TEXTURED", "SPECULAR", "EMISSIVE", "CLUSTERED_LIGHTS", "SHADOWS" };
+const int SHADER_FEATURE_COUNT = sizeof SHADER_FEATURE_NAMES / sizeof SHADER_FEATURE_NAMES[0];
+
+// Identifies a variant: the ShaderFeature bits, and in bits 16-23 the number of shadow-casting lights,
+// which becomes SHADOW_LIGHTS so the loop over them has a constant bound
+typedef uint32_t ShaderVariantKey;
+
+inline ShaderVariantKey makeShaderVariant(uint32_t features, int shadowLights = 0)
+{
+    return (features & 0xFFFF) | (uint32_t)(shadowLights & 0xFF) << 16;
+}
+
+// All variants of one program. The sources declare the features they understand on a line of their
+// own, e.g.
+//
+//   // features: TEXTURED SPECULAR EMISSIVE
+//
+// and a variant is built from them by inserting a #define for every feature of its key, so each one
+// only contains the code its material needs instead of branching on uniforms at run time. Variants
+// are built on first use; precompile() builds the ones a scene needs while it loads. Features a key
+// asks for that no stage declares are dropped with an error, so a typo does not silently build an
+// unintended program.
+class ShaderVariants
+{
+public:
+    uint32_t Features = 0;          // declared by the sources
+    unsigned int Built = 0;
+
+    // defines go into every variant, e.g. array sizes
+    void create(const ShaderSources& sources, ProgramCache* cache, const std::string& defines = "")
+    {
+        this->sources = sources;
+        this->cache = cache;
+        commonDefines = defines;
+        Features = declaredFeatures(sources.vertex) | declaredFeatures(sources.fragment) | declaredFeatures(sources.geometry);
+        programs.clear();
+        Built = 0;
+    }
+
+    // the program of a variant, built now if it has not been yet
+    Shader& get(ShaderVariantKey key)
+    {
+        uint32_t unknown = key & 0xFFFF & ~Features;
+        if (unknown != 0)
+        {
+            std::cout << "ERROR::SHADER_VARIANTS::UNDECLARED_FEATURE:";
+            for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+                if (unknown & (1u << i))
+                    std::cout << " " << SHADER_FEATURE_NAMES[i];
+            std::cout << std::endl;
+            key &= ~unknown;
+        }
+        std::unique_ptr<Shader>& program = programs[key];
+        if (!program)
+        {
+            program.reset(new Shader(sources, cache, commonDefines + defines(key)));
+            Built++;
+        }
+        return *program;
+    }
+
+    void precompile(const std::vector<ShaderVariantKey>& keys)
+    {
+        for (ShaderVariantKey key : keys)
+            get(key);
+    }
+
+    // the #define lines of a key
+    static std::string defines(ShaderVariantKey key)
+    {
+        std::string lines;
+        for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+            if (key & (1u << i))
+                lines += std::string("#define ") + SHADER_FEATURE_NAMES[i] + "\n";
+        if (key >> 16)
+            lines += "#define SHADOW_LIGHTS " + std::to_string(key >> 16) + "\n";
+        return lines;
+    }
+
+private:
+    ShaderSources sources;
+    ProgramCache* cache = nullptr;
+    std::string commonDefines;
+    std::map<ShaderVariantKey, std::unique_ptr<Shader> > programs;
+
+    // the features named on the "// features:" lines of a stage
+    static uint32_t declaredFeatures(const std::string& source)
+    {
+        uint32_t features = 0;
+        const std::string marker = "// features:";
+        for (std::string::size_type at = source.find(marker); at != std::string::npos; at = source.find(marker, at + 1))
+        {
+            std::string::size_type lineEnd = source.find('\n', at);
+            std::istringstream names(source.substr(at + marker.size(), lineEnd == std::string::npos ? std::string::npos : lineEnd - at - marker.size()));
+            std::string name;
+            while (names >> name)
+                for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+                    if (name == SHADER_FEATURE_NAMES[i])
+                        features |= 1u << i;
+        }
+        return features;
+    }
+};
+#endif
@@ -0,0 +1,322 @@
+#ifndef SHADOW_ATLAS_H
+#define SHADOW_ATLAS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include <learnopenggl/camera.h>
+
+#include "frame_arena.h"
+#include "gl_state_cache.h"
+#include "uniform_buffer.h"
+
+// Point light shadows, mirrors the std140 ShadowData block in main.fsh. Light i's cube face f is a
+// FaceSize square at (f, i) in the atlas; origins holds the position it was last rendered from.
+// Every face is a 90 degree perspective view along one axis (faceViewProjection), which the shader
+// rebuilds from the origin with a swizzle instead of fetching a matrix per fragment.
+struct ShadowUniforms
+{
+    enum { MAX_LIGHTS = 4, FACES = 6 };
+
+    glm::vec4 info;                     // light count, 1 / FACES, 1 / MAX_LIGHTS, half a texel of a face
+    glm::vec4 lights[MAX_LIGHTS];       // current position, radius (the far plane of its faces)
+    glm::vec4 colors[MAX_LIGHTS];
+    glm::vec4 origins[MAX_LIGHTS * FACES];
+};
+
+const float SHADOW_NEAR_PLANE = 0.05f;
+
+// a shadow caster's world-space bounding box
+struct CasterBounds
+{
+    glm::vec3 center;
+    glm::vec3 extent;
+};
+
+// Omnidirectional shadow maps for a few point lights, with the six cube faces of every light kept
+// side by side in one depth texture so the lighting shader samples all of them through one sampler.
+//
+// NAIVE re-renders every face of every light each frame. CACHED avoids most of that:
+//  - a stationary light renders the static casters into a second atlas once; a face that a dynamic
+//    caster touches now, or touched last frame, gets that copy blitted back and the dynamic casters
+//    drawn on top, every other face is left as it is
+//  - a moving light renders FaceBudget faces per frame round-robin; the rest keep the shadows (and
+//    the matrix) of the position they were rendered from, a few frames old
+class ShadowAtlas
+{
+public:
+    enum Mode { NAIVE, CACHED };
+
+    Mode CacheMode = CACHED;
+    int FaceBudget = 2;
+    int FaceSize = 0;
+    unsigned int Atlas = 0;
+
+    // work done by the last render()
+    unsigned int FacesRendered = 0;         // all casters, from scratch
+    unsigned int FacesComposited = 0;       // static copy plus dynamic casters
+    unsigned int StaticFacesRendered = 0;   // into the static cache
+    unsigned int DrawCalls = 0;
+
+    bool create(int faceSize, unsigned int uniformBinding)
+    {
+        FaceSize = faceSize;
+        int width = faceSize * ShadowUniforms::FACES, height = faceSize * ShadowUniforms::MAX_LIGHTS;
+        bool complete = createTarget(width, height, Atlas, liveFbo);
+        complete = createTarget(width, height, staticAtlas, staticFbo) && complete;
+
+        // the lighting shader compares against it with hardware PCF
+        glBindTexture(GL_TEXTURE_2D, Atlas);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        uniforms = ShadowUniforms();
+        uniforms.info = glm::vec4(0.0f, 1.0f / ShadowUniforms::FACES, 1.0f / ShadowUniforms::MAX_LIGHTS, 0.5f / faceSize);
+        uniformBuffer.create(sizeof(ShadowUniforms), uniformBinding);
+        return complete;
+    }
+
+    // returns the light's index, -1 if the atlas is full
+    int addLight(const glm::vec3& position, float radius, const glm::vec3& color, bool stationary)
+    {
+        if (lights.size() >= ShadowUniforms::MAX_LIGHTS)
+        {
+            std::cout << "ERROR::SHADOW_ATLAS::FULL: at most " << ShadowUniforms::MAX_LIGHTS << " lights" << std::endl;
+            return -1;
+        }
+        Light light;
+        light.stationary = stationary;
+        light.cursor = 0;
+        for (Face& face : light.faces)
+            face.rendered = face.staticValid = face.hadDynamic = false;
+        lights.push_back(light);
+
+        int index = (int)lights.size() - 1;
+        uniforms.info.x = (float)lights.size();
+        uniforms.lights[index] = glm::vec4(position, radius);
+        uniforms.colors[index] = glm::vec4(color, 1.0f);
+        return index;
+    }
+
+    // moving a stationary light throws its static cache away
+    void setPosition(int index, const glm::vec3& position)
+    {
+        glm::vec4& light = uniforms.lights[index];
+        if (glm::vec3(light) == position)
+            return;
+        light = glm::vec4(position, light.w);
+        if (lights[index].stationary)
+            for (Face& face : lights[index].faces)
+                face.staticValid = false;
+    }
+
+    // the current bounds of what drawDynamic draws; they decide which faces of stationary lights need it
+    void setDynamicCasters(const FrameVector<CasterBounds>& bounds)
+    {
+        dynamicCasters.assign(bounds.begin(), bounds.end());
+    }
+
+    // brings the atlas up to date; the draw callbacks issue the static and the dynamic casters with the
+    // depth program bound through state, which takes each face's view-projection at viewProjectionLocation
+    void render(GLStateCache& state, GLint viewProjectionLocation, const std::function<void()>& drawStatic, const std::function<void()>& drawDynamic)
+    {
+        FacesRendered = FacesComposited = StaticFacesRendered = DrawCalls = 0;
+        GLint viewport[4], framebuffer = 0;
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+        glEnable(GL_SCISSOR_TEST);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        for (int l = 0; l < (int)lights.size(); l++)
+        {
+            Light& light = lights[l];
+            if (CacheMode == NAIVE)
+            {
+                for (int f = 0; f < ShadowUniforms::FACES; f++)
+                    renderFace(l, f, liveFbo, state, viewProjectionLocation, &drawStatic, &drawDynamic);
+                FacesRendered += ShadowUniforms::FACES;
+            }
+            else if (light.stationary)
+            {
+                for (int f = 0; f < ShadowUniforms::FACES; f++)
+                {
+                    Face& face = light.faces[f];
+                    if (!face.staticValid)
+                    {
+                        renderFace(l, f, staticFbo, state, viewProjectionLocation, &drawStatic, NULL);
+                        face.staticValid = true;
+                        face.hadDynamic = true;     // the live face still has to get the new copy
+                        StaticFacesRendered++;
+                    }
+                    bool dynamicNow = touchesDynamic(faceViewProjection(l, f));
+                    if (dynamicNow || face.hadDynamic)
+                    {
+                        composite(l, f);
+                        if (dynamicNow)
+                            renderFace(l, f, liveFbo, state, viewProjectionLocation, NULL, &drawDynamic);
+                        FacesComposited++;
+                    }
+                    face.hadDynamic = dynamicNow;
+                }
+            }
+            else
+            {
+                // faces never rendered come first, whatever the budget
+                int budget = FaceBudget;
+                for (int f = 0; f < ShadowUniforms::FACES; f++)
+                    if (!light.faces[f].rendered)
+                    {
+                        renderFace(l, f, liveFbo, state, viewProjectionLocation, &drawStatic, &drawDynamic);
+                        light.faces[f].rendered = true;
+                        FacesRendered++;
+                        budget--;
+                    }
+                for (; budget > 0; budget--)
+                {
+                    renderFace(l, light.cursor, liveFbo, state, viewProjectionLocation, &drawStatic, &drawDynamic);
+                    light.cursor = (light.cursor + 1) % ShadowUniforms::FACES;
+                    FacesRendered++;
+                }
+            }
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glDisable(GL_SCISSOR_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        uniformBuffer.update(&uniforms);
+    }
+
+    void bind(unsigned int unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, Atlas);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void destroy()
+    {
+        glDeleteFramebuffers(1, &liveFbo);
+        glDeleteFramebuffers(1, &staticFbo);
+        glDeleteTextures(1, &Atlas);
+        glDeleteTextures(1, &staticAtlas);
+        uniformBuffer.destroy();
+    }
+
+private:
+    struct Face
+    {
+        bool rendered;          // moving lights: has content at all
+        bool staticValid;       // stationary lights: the static cache holds this face
+        bool hadDynamic;        // stationary lights: the live face has dynamic casters (or a stale copy) in it
+    };
+
+    struct Light
+    {
+        bool stationary;
+        int cursor;             // the next face a moving light re-renders
+        Face faces[ShadowUniforms::FACES];
+    };
+
+    std::vector<Light> lights;
+    std::vector<CasterBounds> dynamicCasters;
+    ShadowUniforms uniforms;
+    UniformBuffer uniformBuffer;
+    unsigned int staticAtlas = 0;
+    unsigned int liveFbo = 0;
+    unsigned int staticFbo = 0;
+
+    static bool createTarget(int width, int height, unsigned int& texture, unsigned int& fbo)
+    {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "ERROR::FRAMEBUFFER:: Shadow atlas framebuffer is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return complete;
+    }
+
+    // the 90 degree view along one of the cube axes from the face's origin
+    glm::mat4 faceViewProjection(int index, int face) const
+    {
+        static const glm::vec3 directions[ShadowUniforms::FACES] = { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+                                                                     glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+        static const glm::vec3 ups[ShadowUniforms::FACES] = { glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+                                                              glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) };
+        glm::vec3 position(uniforms.origins[index * ShadowUniforms::FACES + face]);
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, SHADOW_NEAR_PLANE, uniforms.lights[index].w);
+        return projection * glm::lookAt(position, position + directions[face], ups[face]);
+    }
+
+    bool touchesDynamic(const glm::mat4& viewProjection) const
+    {
+        Frustum frustum(viewProjection);
+        for (const CasterBounds& caster : dynamicCasters)
+            if (frustum.test(caster.center, caster.extent) != Frustum::OUTSIDE)
+                return true;
+        return false;
+    }
+
+    void setTile(int index, int face) const
+    {
+        glViewport(face * FaceSize, index * FaceSize, FaceSize, FaceSize);
+        glScissor(face * FaceSize, index * FaceSize, FaceSize, FaceSize);
+    }
+
+    // renders the given casters into a face; with static casters the face starts over from the light's current position
+    void renderFace(int index, int face, unsigned int fbo, GLStateCache& state, GLint viewProjectionLocation, const std::function<void()>* drawStatic, const std::function<void()>* drawDynamic)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        setTile(index, face);
+        if (drawStatic != NULL)
+        {
+            uniforms.origins[index * ShadowUniforms::FACES + face] = glm::vec4(glm::vec3(uniforms.lights[index]), 1.0f);
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+        glm::mat4 viewProjection = faceViewProjection(index, face);
+        state.setMat4(viewProjectionLocation, viewProjection);
+        if (drawStatic != NULL)
+        {
+            (*drawStatic)();
+            DrawCalls++;
+        }
+        if (drawDynamic != NULL)
+        {
+            (*drawDynamic)();
+            DrawCalls++;
+        }
+    }
+
+    // the static cache's copy of a face into the live atlas
+    void composite(int index, int face) const
+    {
+        int x = face * FaceSize, y = index * FaceSize;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, liveFbo);
+        setTile(index, face);
+        glBlitFramebuffer(x, y, x + FaceSize, y + FaceSize, x, y, x + FaceSize, y + FaceSize, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    }
+};
+#endif
@@ -0,0 +1,112 @@
+#ifndef STRESS_SCENE_H
+#define STRESS_SCENE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "scene_graph.h"
+
+// Procedural content for scaling benchmarks: fills the chamber, or a grid of chambers tiled next to
+// it, with a given number of extra objects made of the unit cube: small tables (five nodes each)
+// standing on the floor and cubes spinning in the air. Chamber 0 is the hand-written one at the
+// origin, the others are built from the same walls and floor and extend along +x and -z, behind its
+// walls. Object sizes shrink with the density so a chamber never looks solid. The generator has its
+// own seeded random engine, so the same parameters always give the same scene.
+class StressScene
+{
+public:
+    std::vector<int> Spinners;              // the rotating cubes, animated every frame
+    std::vector<glm::vec4> SpinnerMotion;   // their rotation axis and, in w, angular speed
+    std::vector<int> Walls;                 // walls and floors of the added chambers, usable as occluders
+    int Objects = 0;                        // drawn nodes added, walls not counted
+    int Chambers = 1;
+
+    // the inside of a chamber relative to its origin, the same as the hand-written one
+    static glm::vec3 interiorMin() { return glm::vec3(-3.8f, -2.9f, -3.8f); }
+    static glm::vec3 interiorMax() { return glm::vec3(3.8f, 4.8f, 5.8f); }
+
+    // chamber c of a grid x grid tiling
+    static glm::vec3 chamberOrigin(int chamber, int grid)
+    {
+        return glm::vec3(8.2f * (chamber % grid), 0.0f, -10.2f * (chamber / grid));
+    }
+
+    // adds objects spread evenly over grid x grid chambers; tableFraction of them (roughly) are table parts
+    void generate(SceneGraph& scene, int objects, int grid, float tableFraction = 0.2f, unsigned int seed = 1)
+    {
+        Chambers = grid * grid;
+        std::minstd_rand random(seed);
+        std::function<float()> uniform = [&random]() { return (float)(random() - random.min()) / (float)(random.max() - random.min()); };
+
+        for (int c = 1; c < Chambers; c++)
+            addChamber(scene, chamberOrigin(c, grid));
+
+        glm::vec3 low = interiorMin(), high = interiorMax();
+        for (int c = 0; c < Chambers; c++)
+        {
+            int count = objects / Chambers + (c < objects % Chambers ? 1 : 0);
+            glm::vec3 origin = chamberOrigin(c, grid);
+            // the spacing objects would have on a regular grid filling the chamber
+            glm::vec3 size = high - low;
+            float spacing = std::cbrt(size.x * size.y * size.z / std::max(count, 1));
+            float cube = glm::clamp(0.3f * spacing, 0.005f, 0.2f);
+            float table = glm::clamp(0.1f * spacing, 0.01f, 0.4f);
+            for (int added = 0; added < count;)
+            {
+                if (count - added >= 5 && uniform() < tableFraction)
+                {
+                    glm::vec3 position = origin + glm::vec3(glm::mix(low.x, high.x, uniform()), -3.0f, glm::mix(low.z, high.z, uniform()));
+                    addTable(scene, position, table, (int)(uniform() * 4.0f) & 3);
+                    added += 5;
+                    continue;
+                }
+                glm::vec3 position = origin + low + (high - low) * glm::vec3(uniform(), uniform(), uniform());
+                int node = scene.addNode(SceneGraph::NO_PARENT, position, glm::vec3(cube), (int)(uniform() * 4.0f) & 3);
+                glm::vec3 axis = glm::vec3(uniform(), uniform(), uniform()) * 2.0f - 1.0f;
+                if (glm::dot(axis, axis) < 1.0e-4f)
+                    axis = glm::vec3(0.0f, 1.0f, 0.0f);
+                Spinners.push_back(node);
+                SpinnerMotion.push_back(glm::vec4(glm::normalize(axis), 0.5f + 3.0f * uniform()));
+                added++;
+            }
+            Objects += count;
+        }
+    }
+
+    // turns every spinner to its angle at time
+    void animate(SceneGraph& scene, float time) const
+    {
+        for (size_t i = 0; i < Spinners.size(); i++)
+            scene.setRotation(Spinners[i], time * SpinnerMotion[i].w, glm::vec3(SpinnerMotion[i]));
+    }
+
+private:
+    // the hand-written table scaled by size, its legs standing on floor
+    static void addTable(SceneGraph& scene, const glm::vec3& floor, float size, int texture)
+    {
+        int table = scene.addGroup(SceneGraph::NO_PARENT, floor + glm::vec3(0.0f, 3.0f * size, 0.0f));
+        scene.addNode(table, glm::vec3(0.0f), glm::vec3(4.0f, 0.1f, 4.0f) * size, texture);
+        for (int leg = 0; leg < 4; leg++)
+        {
+            glm::vec3 position(leg & 1 ? 1.8f : -1.8f, -1.5f, leg & 2 ? 1.8f : -1.8f);
+            scene.addNode(table, position * size, glm::vec3(0.2f, -3.0f, 0.2f) * size, texture);
+        }
+    }
+
+    void addChamber(SceneGraph& scene, const glm::vec3& origin)
+    {
+        int chamber = scene.addGroup(SceneGraph::NO_PARENT, origin);
+        Walls.push_back(scene.addNode(chamber, glm::vec3(0.0f, 1.0f, -4.0f), glm::vec3(8.0f, 8.0f, 0.1f), 3));
+        Walls.push_back(scene.addNode(chamber, glm::vec3(-4.0f, 1.0f, 1.0f), glm::vec3(0.1f, 8.0f, 10.0f), 3));
+        Walls.push_back(scene.addNode(chamber, glm::vec3(4.0f, 1.0f, 1.0f), glm::vec3(0.1f, 8.0f, 10.0f), 3));
+        Walls.push_back(scene.addNode(chamber, glm::vec3(0.0f, -3.0f, 1.0f), glm::vec3(8.0f, 0.1f, 10.0f), 3));
+        Walls.push_back(scene.addNode(chamber, glm::vec3(0.0f, 5.0f, 1.0f), glm::vec3(8.0f, 0.1f, 10.0f), 3));
+        Walls.push_back(scene.addNode(chamber, glm::vec3(0.0f, 1.0f, 6.0f), glm::vec3(8.0f, 8.0f, 0.1f), 3));
+    }
+};
+#endif
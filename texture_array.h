@@ -0,0 +1,163 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <vector>
+
+#include "image_resize.h"
+#include "ktx_format.h"
+
+// Size every layer of the scene's texture array is resampled to
+const int TEXTURE_ARRAY_SIZE = 1024;
+
+// All scene textures in one GL_TEXTURE_2D_ARRAY, so every object can be drawn from a single
+// binding and pick its image with a per-instance layer index.
+class TextureArray
+{
+public:
+    unsigned int ID = 0;
+    int Width = 0;
+    int Height = 0;
+    int Layers = 0;
+
+    int Levels = 1;
+    GLenum InternalFormat = GL_RGB8;
+
+    // allocates every layer and mip level; internalFormat is GL_RGB8 or one of the compressed formats of ktx_format.h
+    void create(int width, int height, int layers, int levels = 1, GLenum internalFormat = GL_RGB8)
+    {
+        Width = width;
+        Height = height;
+        Layers = layers;
+        Levels = levels;
+        InternalFormat = internalFormat;
+
+        glGenTextures(1, &ID);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+
+        // Set the filtering methods for magnification and minification, trilinear once there is a mip chain
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        // Set the wrapping method for the s-axis (x-axis) and t-axis (y-axis)
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        for (int level = 0; level < levels; level++)
+        {
+            int levelWidth = mipSize(width, level);
+            int levelHeight = mipSize(height, level);
+            if (internalFormat == GL_RGB8)
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGB8, levelWidth, levelHeight, layers, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+            else
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, levelWidth, levelHeight, layers, 0,
+                                       ktxLevelSize(internalFormat, levelWidth, levelHeight) * layers, NULL);
+        }
+    }
+
+    // uploads tightly packed RGB pixels of one mip level of a layer; with a GL_PIXEL_UNPACK_BUFFER bound,
+    // pixels is an offset into that buffer
+    void uploadLayer(int layer, const unsigned char* pixels, int level = 0)
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, mipSize(Width, level), mipSize(Height, level), 1, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    // uploads one pre-compressed mip level of a layer, e.g. straight from a KtxFile (Data may be a buffer offset as above)
+    void uploadCompressedLayer(int layer, int level, const KtxLevel& data)
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, data.Width, data.Height, 1, InternalFormat, data.Size, data.Data);
+    }
+
+    // fills every level of every layer with one color, so the array can be sampled before its images are loaded
+    void fillPlaceholder(unsigned char r, unsigned char g, unsigned char b)
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        std::vector<unsigned char> data;
+        for (int level = 0; level < Levels; level++)
+        {
+            int levelWidth = mipSize(Width, level);
+            int levelHeight = mipSize(Height, level);
+            if (InternalFormat == GL_RGB8)
+            {
+                data.resize((size_t)levelWidth * levelHeight * Layers * 3);
+                for (size_t i = 0; i < data.size(); i += 3)
+                {
+                    data[i] = r;
+                    data[i + 1] = g;
+                    data[i + 2] = b;
+                }
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, levelWidth, levelHeight, Layers, GL_RGB, GL_UNSIGNED_BYTE, data.data());
+            }
+            else
+            {
+                unsigned char block[16];
+                uint32_t blockBytes = ktxBlockBytes(InternalFormat);
+                ktxSolidBlock(InternalFormat, r, g, b, block);
+                data.resize((size_t)ktxLevelSize(InternalFormat, levelWidth, levelHeight) * Layers);
+                for (size_t i = 0; i < data.size(); i += blockBytes)
+                    memcpy(&data[i], block, blockBytes);
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, levelWidth, levelHeight, Layers, InternalFormat, (GLsizei)data.size(), data.data());
+            }
+        }
+    }
+
+    // fills the levels below 0 from the uploaded base images, for textures that were not baked offline
+    void generateMipmaps()
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+
+    void bind(int unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+    }
+
+    void destroy()
+    {
+        glDeleteTextures(1, &ID);
+    }
+
+    static int mipSize(int size, int level)
+    {
+        size >>= level;
+        return size > 0 ? size : 1;
+    }
+
+    // number of levels of a full mip chain down to 1x1
+    static int mipLevelCount(int width, int height)
+    {
+        int levels = 1;
+        while ((width | height) >> levels)
+            levels++;
+        return levels;
+    }
+
+    // whether the context can sample the given compressed format (S3TC and BPTC are extensions in GL 3.3)
+    static bool supportsFormat(GLenum internalFormat)
+    {
+        const char* extension = internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? "GL_EXT_texture_compression_s3tc" :
+                                internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM ? "GL_ARB_texture_compression_bptc" : NULL;
+        if (extension == NULL)
+            return false;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (name != NULL && strcmp(name, extension) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+#endif
@@ -0,0 +1,276 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "asset_pack.h"
+#include "ktx_format.h"
+#include "profiler.h"
+#include "texture_array.h"
+#include "thread_pool.h"
+
+// Fills a TextureArray in the background. Images are read and decoded on a ThreadPool while the
+// array, filled with a placeholder color, can already be drawn with; every frame update() copies
+// finished images into a small ring of pixel buffer objects and lets the driver pull them from
+// there, so the render thread never waits for a decode or a synchronous texture upload.
+//
+// Like the synchronous loader before it, it prefers the baked .ktx next to each source image and
+// decodes the sources with stb_image (building the mip chain on the GPU) only if any is unusable.
+// Baked files found in an AssetPack are parsed in place in the mapping, their levels copied from
+// there straight into the upload buffers.
+class TextureStreamer
+{
+public:
+    enum { PBO_RING_SIZE = 3 };
+
+    // bytes copied into the ring per update(); a layer larger than this still goes up in one piece
+    size_t UploadBudget = 4 * 1024 * 1024;
+
+    // creates the array (layer i is paths[i]), fills it with the placeholder and queues the decodes;
+    // the pack, if given, has to stay open until done()
+    void start(TextureArray& array, const std::vector<std::string>& paths, ThreadPool& pool, const AssetPack* pack = NULL)
+    {
+        textures = &array;
+        this->pack = pack;
+        pendingLayers = (int)paths.size();
+
+        // layers of an array share one format, size and mip chain, so all baked files have to agree
+        compressed = true;
+        KtxHeader first = {};
+        std::vector<std::string> bakedPaths;
+        for (size_t i = 0; i < paths.size() && compressed; i++)
+        {
+            bakedPaths.push_back(paths[i].substr(0, paths[i].rfind('.')) + ".ktx");
+            KtxHeader header;
+            const AssetPackEntry* entry = pack != NULL ? pack->find(bakedPaths[i]) : NULL;
+            if (entry != NULL)
+            {
+                compressed = entry->size >= sizeof header;
+                if (compressed)
+                {
+                    memcpy(&header, pack->data(*entry), sizeof header);
+                    compressed = ktxHeaderSupported(header);
+                }
+            }
+            else
+                compressed = readKtxHeader(bakedPaths[i].c_str(), header);
+            if (i == 0)
+                first = header;
+            compressed = compressed && header.glInternalFormat == first.glInternalFormat && header.pixelWidth == first.pixelWidth &&
+                         header.pixelHeight == first.pixelHeight && header.numberOfMipmapLevels == first.numberOfMipmapLevels;
+        }
+        compressed = compressed && !paths.empty() && TextureArray::supportsFormat(first.glInternalFormat);
+
+        if (compressed)
+            array.create(first.pixelWidth, first.pixelHeight, (int)paths.size(), first.numberOfMipmapLevels, first.glInternalFormat);
+        else
+            array.create(TEXTURE_ARRAY_SIZE, TEXTURE_ARRAY_SIZE, (int)paths.size(), TextureArray::mipLevelCount(TEXTURE_ARRAY_SIZE, TEXTURE_ARRAY_SIZE));
+        array.fillPlaceholder(128, 128, 128);
+
+        // every buffer of the ring holds one whole layer: all levels of a baked file or level 0 of a decoded image
+        pboSize = compressed ? 0 : (size_t)array.Width * array.Height * 3;
+        for (int level = 0; compressed && level < array.Levels; level++)
+            pboSize += ktxLevelSize(first.glInternalFormat, TextureArray::mipSize(array.Width, level), TextureArray::mipSize(array.Height, level));
+        glGenBuffers(PBO_RING_SIZE, pbos);
+        for (int i = 0; i < PBO_RING_SIZE; i++)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, pboSize, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        // Im image-space (pixels), (0, 0) is the upper-left corner of the image, in u-v coordinates it is the
+        // lower-left one, so the decoded images are flipped (baked ones are stored flipped already)
+        stbi_set_flip_vertically_on_load(true);
+
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            int layer = (int)i;
+            std::string path = compressed ? bakedPaths[i] : paths[i];
+            int width = array.Width, height = array.Height;
+            bool decodeKtx = compressed;
+            const AssetPackEntry* entry = compressed && pack != NULL ? pack->find(path) : NULL;
+            pool.submit([this, layer, path, width, height, decodeKtx, pack, entry]() {
+                PROFILE_ZONE("decode texture");
+                std::unique_ptr<DecodedLayer> decoded(new DecodedLayer());
+                decoded->layer = layer;
+                if (entry != NULL)
+                {
+                    // start reading the pages in now, not when the GL thread copies them
+                    pack->prefetch(*entry);
+                    decoded->packed = entry;
+                    decoded->loaded = decoded->ktx.loadFromMemory(pack->data(*entry), (size_t)entry->size, path.c_str());
+                }
+                else if (decodeKtx)
+                    decoded->loaded = decoded->ktx.load(path.c_str());
+                else
+                    decoded->loaded = decodeImage(path, width, height, decoded->pixels);
+                if (!decoded->loaded)
+                    std::cout << "ERROR::TEXTURE_STREAMER::LOAD_FAILED: " << path << std::endl;
+                std::lock_guard<std::mutex> lock(decodedMutex);
+                finished.push_back(std::move(decoded));
+            });
+        }
+    }
+
+    // uploads what the workers finished since the last call; call once per frame on the GL thread
+    void update()
+    {
+        PROFILE_ZONE("upload textures");
+        size_t uploaded = 0;
+        bool sourceLayerDone = false;
+        while (pendingLayers > 0 && uploaded < UploadBudget)
+        {
+            if (!current)
+            {
+                std::lock_guard<std::mutex> lock(decodedMutex);
+                if (finished.empty())
+                    break;
+                current = std::move(finished.front());
+                finished.pop_front();
+            }
+
+            // a failed layer keeps its placeholder
+            if (current->loaded)
+            {
+                size_t size = upload(*current);
+                if (size == 0)
+                    break;      // every buffer of the ring is still being read by the GPU
+                uploaded += size;
+                if (current->packed != NULL)
+                    pack->release(*current->packed);
+                sourceLayerDone = sourceLayerDone || !compressed;
+            }
+            current.reset();
+            pendingLayers--;
+        }
+
+        // decoded sources only bring level 0, derive the rest of their chain
+        if (sourceLayerDone)
+            textures->generateMipmaps();
+    }
+
+    bool done() const
+    {
+        return pendingLayers == 0;
+    }
+
+    // the pool has to be stopped first, so no worker still writes into the streamer
+    void destroy()
+    {
+        for (int i = 0; i < PBO_RING_SIZE; i++)
+        {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        glDeleteBuffers(PBO_RING_SIZE, pbos);
+        current.reset();
+        finished.clear();
+    }
+
+private:
+    struct DecodedLayer
+    {
+        int layer = 0;
+        bool loaded = false;
+        KtxFile ktx;                            // baked: the whole file (or its pack entry), levels point into it
+        const AssetPackEntry* packed = NULL;    // the pack entry ktx points into
+        std::vector<unsigned char> pixels;      // source image: level 0 as RGB, resampled to the array size
+    };
+
+    TextureArray* textures = NULL;
+    const AssetPack* pack = NULL;
+    bool compressed = false;
+    int pendingLayers = 0;
+
+    std::mutex decodedMutex;
+    std::deque<std::unique_ptr<DecodedLayer> > finished;
+    std::unique_ptr<DecodedLayer> current;
+    std::vector<KtxLevel> pendingUploads;
+
+    unsigned int pbos[PBO_RING_SIZE] = {};
+    GLsync fences[PBO_RING_SIZE] = {};
+    int nextPbo = 0;
+    size_t pboSize = 0;
+
+    static bool decodeImage(const std::string& path, int width, int height, std::vector<unsigned char>& pixels)
+    {
+        int imageWidth, imageHeight, numChannels;
+        unsigned char* imageData = stbi_load(path.c_str(), &imageWidth, &imageHeight, &numChannels, 3);
+        if (imageData == nullptr)
+            return false;
+        // layers of an array share one size, so resample the image to it
+        pixels = resizeImage(imageData, imageWidth, imageHeight, 3, width, height);
+        stbi_image_free(imageData);
+        return true;
+    }
+
+    // copies every level of a layer into the next buffer of the ring and starts their transfer into the
+    // array; returns the bytes copied, 0 if that buffer's previous transfer has not finished yet
+    size_t upload(const DecodedLayer& decoded)
+    {
+        GLsync& fence = fences[nextPbo];
+        if (fence)
+        {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                return 0;
+            glDeleteSync(fence);
+            fence = 0;
+        }
+
+        size_t size = compressed ? 0 : decoded.pixels.size();
+        for (const KtxLevel& level : decoded.ktx.Levels)
+            size += level.Size;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[nextPbo]);
+        // the fence guarantees the GPU is done with the buffer, so there is nothing to synchronize with
+        char* mapped = (char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (mapped != NULL)
+        {
+            if (compressed)
+            {
+                size_t offset = 0;
+                for (size_t i = 0; i < decoded.ktx.Levels.size(); i++)
+                {
+                    KtxLevel level = decoded.ktx.Levels[i];
+                    memcpy(mapped + offset, level.Data, level.Size);
+                    level.Data = (const char*)offset;
+                    offset += level.Size;
+                    pendingUploads.push_back(level);
+                }
+            }
+            else
+            {
+                memcpy(mapped, decoded.pixels.data(), size);
+            }
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            // with the buffer bound, the data pointers are offsets into it
+            if (compressed)
+                for (size_t i = 0; i < pendingUploads.size(); i++)
+                    textures->uploadCompressedLayer(decoded.layer, (int)i, pendingUploads[i]);
+            else
+                textures->uploadLayer(decoded.layer, (const unsigned char*)0);
+            pendingUploads.clear();
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        else
+        {
+            std::cout << "ERROR::TEXTURE_STREAMER::MAP_FAILED: layer " << decoded.layer << std::endl;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        nextPbo = (nextPbo + 1) % PBO_RING_SIZE;
+        return size;
+    }
+};
+#endif
@@ -0,0 +1,84 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+
+// A fixed set of worker threads pulling tasks from one shared FIFO queue. Meant for coarse
+// background work such as decoding assets; tasks must not touch the GL context.
+class ThreadPool
+{
+public:
+    // threadCount 0 leaves one hardware thread to the render thread
+    void start(int threadCount = 0)
+    {
+        if (threadCount <= 0)
+        {
+            threadCount = (int)std::thread::hardware_concurrency() - 1;
+            if (threadCount < 1)
+                threadCount = 1;
+        }
+        stopping = false;
+        for (int i = 0; i < threadCount; i++)
+            workers.emplace_back(&ThreadPool::run, this);
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // runs the tasks still queued, then joins the workers
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    int size() const
+    {
+        return (int)workers.size();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void run()
+    {
+        PROFILE_THREAD("pool worker");
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+#endif
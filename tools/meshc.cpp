@@ -0,0 +1,383 @@
+// Offline mesh compiler: turns a Wavefront OBJ into the indexed, quantized binary format of
+// mesh_format.h that Mesh (mesh.h) uploads straight into GPU buffers.
+//
+//   1. triangulates faces and deduplicates identical position/uv/normal corners into an index buffer
+//   2. reorders triangles for the post-transform vertex cache (Tom Forsyth's linear-speed algorithm)
+//   3. reorders vertices by first use, so vertex fetches walk the buffer linearly
+//   4. quantizes uv to half floats and normals to 10_10_10_2, drops vertex colors
+//
+// Build:  g++ -O2 -std=c++11 -I. tools/meshc.cpp -o meshc
+// Usage:  meshc input.obj output.mesh
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mesh_format.h"
+
+struct Float3
+{
+    float x, y, z;
+};
+
+struct Float2
+{
+    float x, y;
+};
+
+// one deduplicated vertex, still at full precision
+struct SourceVertex
+{
+    Float3 position;
+    Float2 uv;
+    Float3 normal;
+};
+
+struct ObjData
+{
+    std::vector<SourceVertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// resolves a 1-based (or negative, relative) OBJ index; returns -1 if missing or out of range
+static int resolveIndex(const std::string& token, size_t count)
+{
+    if (token.empty())
+        return -1;
+    long i = strtol(token.c_str(), NULL, 10);
+    long resolved = i > 0 ? i - 1 : (long)count + i;
+    return resolved >= 0 && resolved < (long)count ? (int)resolved : -1;
+}
+
+static bool loadObj(const char* path, ObjData& out)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "meshc: cannot open " << path << std::endl;
+        return false;
+    }
+
+    std::vector<Float3> positions;
+    std::vector<Float2> uvs;
+    std::vector<Float3> normals;
+    // corner (position, uv, normal) -> vertex index
+    std::map<std::vector<int>, uint32_t> corners;
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        std::istringstream in(line);
+        std::string keyword;
+        in >> keyword;
+        if (keyword == "v")
+        {
+            Float3 p = { 0.0f, 0.0f, 0.0f };
+            in >> p.x >> p.y >> p.z;
+            positions.push_back(p);
+        }
+        else if (keyword == "vt")
+        {
+            Float2 t = { 0.0f, 0.0f };
+            in >> t.x >> t.y;
+            uvs.push_back(t);
+        }
+        else if (keyword == "vn")
+        {
+            Float3 n = { 0.0f, 0.0f, 1.0f };
+            in >> n.x >> n.y >> n.z;
+            normals.push_back(n);
+        }
+        else if (keyword == "f")
+        {
+            std::vector<uint32_t> polygon;
+            std::string corner;
+            while (in >> corner)
+            {
+                // v, v/t, v//n or v/t/n
+                std::string parts[3];
+                size_t start = 0;
+                for (int k = 0; k < 3; k++)
+                {
+                    size_t slash = corner.find('/', start);
+                    parts[k] = corner.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+                    if (slash == std::string::npos)
+                        break;
+                    start = slash + 1;
+                }
+                std::vector<int> key(3);
+                key[0] = resolveIndex(parts[0], positions.size());
+                key[1] = resolveIndex(parts[1], uvs.size());
+                key[2] = resolveIndex(parts[2], normals.size());
+                if (key[0] < 0)
+                {
+                    std::cerr << "meshc: " << path << ":" << lineNumber << ": bad vertex reference '" << corner << "'" << std::endl;
+                    return false;
+                }
+
+                std::map<std::vector<int>, uint32_t>::iterator it = corners.find(key);
+                if (it == corners.end())
+                {
+                    SourceVertex v;
+                    v.position = positions[key[0]];
+                    v.uv = key[1] >= 0 ? uvs[key[1]] : Float2{ 0.0f, 0.0f };
+                    v.normal = key[2] >= 0 ? normals[key[2]] : Float3{ 0.0f, 0.0f, 1.0f };
+                    it = corners.insert(std::make_pair(key, (uint32_t)out.vertices.size())).first;
+                    out.vertices.push_back(v);
+                }
+                polygon.push_back(it->second);
+            }
+            // triangle fan, keeps the winding of the source polygon
+            for (size_t k = 2; k < polygon.size(); k++)
+            {
+                out.indices.push_back(polygon[0]);
+                out.indices.push_back(polygon[k - 1]);
+                out.indices.push_back(polygon[k]);
+            }
+        }
+    }
+
+    if (out.indices.empty())
+    {
+        std::cerr << "meshc: " << path << " has no faces" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// average cache miss ratio (transformed vertices per triangle) of a FIFO post-transform cache
+static float computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize)
+{
+    std::vector<int> insertedAt(vertexCount, -1000000);
+    int time = 0;
+    int misses = 0;
+    for (uint32_t index : indices)
+    {
+        if (time - insertedAt[index] >= cacheSize)
+        {
+            insertedAt[index] = time++;
+            misses++;
+        }
+    }
+    return (float)misses / (indices.size() / 3);
+}
+
+// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation" (2006)
+namespace forsyth
+{
+    const int CACHE_SIZE = 32;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRI_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    static float vertexScore(int cachePosition, int remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                score = LAST_TRI_SCORE;
+            else
+                score = powf(1.0f - (cachePosition - 3) / (float)(CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+        return score + VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -VALENCE_BOOST_POWER);
+    }
+
+    static std::vector<uint32_t> optimize(const std::vector<uint32_t>& indices, size_t vertexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+
+        // triangles using each vertex
+        std::vector<int> remaining(vertexCount, 0);
+        for (uint32_t index : indices)
+            remaining[index]++;
+        std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+        std::vector<uint32_t> vertexTriangles(indices.size());
+        std::vector<size_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+            for (int k = 0; k < 3; k++)
+                vertexTriangles[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> score(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            score[v] = vertexScore(-1, remaining[v]);
+
+        std::vector<float> triangleScore(triangleCount);
+        std::vector<bool> emitted(triangleCount, false);
+        for (size_t t = 0; t < triangleCount; t++)
+            triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        std::vector<uint32_t> cache;
+        size_t scanFrom = 0;
+
+        for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+        {
+            // best triangle touching the cache; fall back to a linear scan when the cache has none left
+            int best = -1;
+            float bestScore = -1.0f;
+            for (uint32_t v : cache)
+            {
+                for (size_t i = firstTriangle[v]; i < firstTriangle[v + 1]; i++)
+                {
+                    uint32_t t = vertexTriangles[i];
+                    if (!emitted[t] && triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        best = (int)t;
+                    }
+                }
+            }
+            if (best < 0)
+            {
+                while (emitted[scanFrom])
+                    scanFrom++;
+                best = (int)scanFrom;
+            }
+
+            emitted[best] = true;
+            std::vector<uint32_t> newCache;
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t v = indices[best * 3 + k];
+                result.push_back(v);
+                remaining[v]--;
+                newCache.push_back(v);
+            }
+            for (uint32_t v : cache)
+                if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+                    newCache.push_back(v);
+
+            // vertices pushed out of the cache lose their cache bonus
+            for (size_t i = CACHE_SIZE; i < newCache.size(); i++)
+            {
+                cachePosition[newCache[i]] = -1;
+                score[newCache[i]] = vertexScore(-1, remaining[newCache[i]]);
+            }
+            if (newCache.size() > (size_t)CACHE_SIZE)
+                newCache.resize(CACHE_SIZE);
+
+            for (size_t i = 0; i < newCache.size(); i++)
+            {
+                cachePosition[newCache[i]] = (int)i;
+                score[newCache[i]] = vertexScore((int)i, remaining[newCache[i]]);
+            }
+            for (uint32_t v : newCache)
+                for (size_t i = firstTriangle[v]; i < firstTriangle[v + 1]; i++)
+                {
+                    uint32_t t = vertexTriangles[i];
+                    if (!emitted[t])
+                        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                }
+            cache.swap(newCache);
+        }
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: meshc input.obj output.mesh" << std::endl;
+        return 1;
+    }
+
+    ObjData obj;
+    if (!loadObj(argv[1], obj))
+        return 1;
+
+    size_t vertexCount = obj.vertices.size();
+    float acmrBefore = computeACMR(obj.indices, vertexCount, 16);
+    std::vector<uint32_t> indices = forsyth::optimize(obj.indices, vertexCount);
+    float acmrAfter = computeACMR(indices, vertexCount, 16);
+
+    // renumber vertices in order of first use
+    std::vector<int> remap(vertexCount, -1);
+    std::vector<SourceVertex> ordered;
+    ordered.reserve(vertexCount);
+    for (uint32_t& index : indices)
+    {
+        if (remap[index] < 0)
+        {
+            remap[index] = (int)ordered.size();
+            ordered.push_back(obj.vertices[index]);
+        }
+        index = (uint32_t)remap[index];
+    }
+
+    MeshFileHeader header;
+    memcpy(header.magic, MESH_FILE_MAGIC, sizeof header.magic);
+    header.version = MESH_FILE_VERSION;
+    header.vertexCount = (uint32_t)ordered.size();
+    header.indexCount = (uint32_t)indices.size();
+    header.indexSize = ordered.size() <= 0xffff ? 2 : 4;
+    header.vertexStride = sizeof(PackedVertex);
+    header.vertexOffset = sizeof(MeshFileHeader);
+    header.indexOffset = header.vertexOffset + header.vertexCount * header.vertexStride;
+
+    std::vector<PackedVertex> packed(ordered.size());
+    for (size_t i = 0; i < ordered.size(); i++)
+    {
+        const SourceVertex& v = ordered[i];
+        packed[i].position[0] = v.position.x;
+        packed[i].position[1] = v.position.y;
+        packed[i].position[2] = v.position.z;
+        packed[i].uv[0] = floatToHalf(v.uv.x);
+        packed[i].uv[1] = floatToHalf(v.uv.y);
+        float length = sqrtf(v.normal.x * v.normal.x + v.normal.y * v.normal.y + v.normal.z * v.normal.z);
+        if (length <= 0.0f)
+            length = 1.0f;
+        packed[i].normal = packNormal(v.normal.x / length, v.normal.y / length, v.normal.z / length);
+
+        float p[3] = { v.position.x, v.position.y, v.position.z };
+        for (int k = 0; k < 3; k++)
+        {
+            header.boundsMin[k] = i == 0 ? p[k] : std::min(header.boundsMin[k], p[k]);
+            header.boundsMax[k] = i == 0 ? p[k] : std::max(header.boundsMax[k], p[k]);
+        }
+    }
+
+    std::ofstream out(argv[2], std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "meshc: cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+    out.write((const char*)&header, sizeof header);
+    out.write((const char*)packed.data(), packed.size() * sizeof(PackedVertex));
+    if (header.indexSize == 2)
+    {
+        std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+        out.write((const char*)shortIndices.data(), shortIndices.size() * sizeof(uint16_t));
+    }
+    else
+    {
+        out.write((const char*)indices.data(), indices.size() * sizeof(uint32_t));
+    }
+
+    size_t unindexedBytes = obj.indices.size() * 36;     // the old 36-byte unindexed Vertex layout
+    size_t bytes = header.indexOffset + header.indexCount * header.indexSize;
+    std::cout << argv[2] << ": " << header.vertexCount << " vertices, " << header.indexCount / 3 << " triangles, "
+              << bytes << " bytes (" << unindexedBytes << " unindexed at 36 bytes/vertex), ACMR "
+              << acmrBefore << " -> " << acmrAfter << std::endl;
+    return 0;
+}
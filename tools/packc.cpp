@@ -0,0 +1,140 @@
+// Asset packer: writes loose asset files into the single archive of asset_pack_format.h that the
+// demo maps with --pack, or checks an existing archive.
+//
+//   1. sorts the files by name, so the runtime finds entries with a binary search
+//   2. starts every file's data on a page boundary (ASSET_PACK_ALIGNMENT), zero padded
+//   3. stores a 64-bit FNV-1a hash of every file's contents
+//
+// Entries are named by the paths given on the command line, which have to be the paths the demo
+// opens them by (relative to the working directory it runs in).
+//
+// Build:  g++ -O2 -std=c++11 -I. tools/packc.cpp -o packc
+// Usage:  packc output.pack file...          e.g. packc assets.pack *.vsh *.fsh cube.mesh *.ktx
+//         packc --verify input.pack          lists the entries and checks their hashes
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "asset_pack.h"
+
+struct SourceFile
+{
+    std::string name;
+    std::vector<char> data;
+};
+
+static bool readFile(const std::string& path, std::vector<char>& data)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file)
+        return false;
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static uint64_t alignUp(uint64_t offset)
+{
+    return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+}
+
+static int verify(const char* path)
+{
+    AssetPack pack;
+    if (!pack.open(path))
+    {
+        std::cerr << "packc: cannot open " << path << std::endl;
+        return 1;
+    }
+    int failed = 0;
+    for (size_t i = 0; i < pack.size(); i++)
+    {
+        const AssetPackEntry& entry = pack.entry(i);
+        bool valid = pack.verify(entry);
+        failed += valid ? 0 : 1;
+        std::cout << entry.name << "  " << entry.size << " bytes at " << entry.offset << (valid ? "" : "  HASH MISMATCH") << std::endl;
+    }
+    std::cout << pack.size() << " entries, " << failed << " corrupt" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 3 && strcmp(argv[1], "--verify") == 0)
+        return verify(argv[2]);
+    if (argc < 3)
+    {
+        std::cerr << "Usage: packc output.pack file...\n       packc --verify input.pack" << std::endl;
+        return 1;
+    }
+
+    std::vector<SourceFile> files(argc - 2);
+    for (int i = 2; i < argc; i++)
+    {
+        SourceFile& file = files[i - 2];
+        file.name = argv[i];
+        if (file.name.size() >= ASSET_PACK_NAME_SIZE)
+        {
+            std::cerr << "packc: name longer than " << ASSET_PACK_NAME_SIZE - 1 << " characters: " << file.name << std::endl;
+            return 1;
+        }
+        if (!readFile(file.name, file.data))
+        {
+            std::cerr << "packc: cannot read " << file.name << std::endl;
+            return 1;
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const SourceFile& a, const SourceFile& b) { return strcmp(a.name.c_str(), b.name.c_str()) < 0; });
+    for (size_t i = 1; i < files.size(); i++)
+        if (files[i].name == files[i - 1].name)
+        {
+            std::cerr << "packc: " << files[i].name << " given twice" << std::endl;
+            return 1;
+        }
+
+    AssetPackHeader header;
+    memcpy(header.magic, ASSET_PACK_MAGIC, sizeof header.magic);
+    header.version = ASSET_PACK_VERSION;
+    header.entryCount = (uint32_t)files.size();
+    header.alignment = ASSET_PACK_ALIGNMENT;
+    header.tableOffset = sizeof header;
+
+    std::vector<AssetPackEntry> entries(files.size());
+    uint64_t offset = header.tableOffset + entries.size() * sizeof(AssetPackEntry);
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        AssetPackEntry& entry = entries[i];
+        memset(&entry, 0, sizeof entry);
+        memcpy(entry.name, files[i].name.c_str(), files[i].name.size());
+        offset = alignUp(offset);
+        entry.offset = offset;
+        entry.size = files[i].data.size();
+        entry.hash = assetPackHash(files[i].data.data(), files[i].data.size());
+        offset += entry.size;
+    }
+    header.fileSize = offset;
+
+    std::ofstream out(argv[1], std::ios::binary);
+    out.write((const char*)&header, sizeof header);
+    out.write((const char*)entries.data(), entries.size() * sizeof(AssetPackEntry));
+    uint64_t written = header.tableOffset + entries.size() * sizeof(AssetPackEntry);
+    std::vector<char> padding(ASSET_PACK_ALIGNMENT, 0);
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        out.write(padding.data(), (std::streamsize)(entries[i].offset - written));
+        out.write(files[i].data.data(), (std::streamsize)files[i].data.size());
+        written = entries[i].offset + entries[i].size;
+    }
+    if (!out)
+    {
+        std::cerr << "packc: cannot write " << argv[1] << std::endl;
+        return 1;
+    }
+    std::cout << "packed " << files.size() << " files into " << argv[1] << " (" << header.fileSize << " bytes)" << std::endl;
+    return 0;
+}
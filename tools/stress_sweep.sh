@@ -0,0 +1,49 @@
+#!/bin/sh
+# Scaling sweep: runs the demo headless on generated stress scenes, first growing the object count
+# with no point lights, then the point light count with no extra objects, and prints one CSV row
+# per run with the mean CPU update (job graph), submission, CPU frame, GPU and frame times and the
+# memory used, ready to plot.
+#
+# Run from the repository root (the demo loads its assets from the working directory):
+#   tools/stress_sweep.sh > sweep.csv
+#
+# Environment:
+#   MAIN      the demo binary (default ./Main)
+#   FRAMES    measured frames per run (default 60), WARMUP frames before them (default 5)
+#   OBJECTS   object counts to sweep (default 10 100 1000 10000 100000 1000000)
+#   LIGHTS    light counts to sweep (default the same)
+#   GRID      chambers per side the objects and lights are spread over (default 1)
+#   SHADOWS   off, naive or cached (default off, every spinning cube would be a moving caster)
+#   EXTRA     further demo options, e.g. "--threads 4 --no-occlusion-culling"
+
+MAIN=${MAIN:-./Main}
+FRAMES=${FRAMES:-60}
+WARMUP=${WARMUP:-5}
+OBJECTS=${OBJECTS:-"10 100 1000 10000 100000 1000000"}
+LIGHTS=${LIGHTS:-"10 100 1000 10000 100000 1000000"}
+GRID=${GRID:-1}
+SHADOWS=${SHADOWS:-off}
+RESULT=${TMPDIR:-/tmp}/stress_sweep.$$.json
+
+# the mean of a series, or a plain value, from the demo's JSON report
+value() {
+    sed -n "s/.*\"$1\": { \"mean\": \([^,]*\),.*/\1/p; s/.*\"$1\": \([0-9.e+-]*\).*/\1/p" "$RESULT" | head -n 1
+}
+
+run() {
+    if ! "$MAIN" --headless --frames "$FRAMES" --warmup "$WARMUP" --shadows "$SHADOWS" --stress-grid "$GRID" \
+                 --stress-objects "$1" --lights "$2" $EXTRA --output "$RESULT" > /dev/null; then
+        echo "$1,$2,failed"
+        return
+    fi
+    echo "$1,$2,$(value simulate_ms),$(value submit_ms),$(value cpu_ms),$(value gpu_ms),$(value frame_ms),$(value peak_rss_mb),$(value gpu_buffers_mb)"
+}
+
+echo "objects,lights,update_ms,submit_ms,cpu_ms,gpu_ms,frame_ms,peak_rss_mb,gpu_buffers_mb"
+for objects in $OBJECTS; do
+    run "$objects" 0
+done
+for lights in $LIGHTS; do
+    run 0 "$lights"
+done
+rm -f "$RESULT"
@@ -0,0 +1,495 @@
+// Offline texture baker: turns a source image into the block-compressed, fully mipmapped KTX
+// container of ktx_format.h that TextureArray (texture_array.h) uploads level by level.
+//
+//   1. decodes the image, flips it to GL's bottom-up row order and resamples it to the array size
+//   2. builds the mip chain with a 2x2 box filter (SSE2, rows split across worker threads)
+//   3. encodes every level to BC1 (default) or BC7 mode 6, block rows split across worker threads
+//
+// Build:  g++ -O2 -std=c++11 -msse2 -pthread -I. -I<stb_image include dir> tools/texbake.cpp -o texbake
+// Usage:  texbake [--format bc1|bc7] [--size 1024] input.jpg output.ktx
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXBAKE_SSE2 1
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "image_resize.h"
+#include "ktx_format.h"
+
+#ifndef GL_RGB
+#define GL_RGB 0x1907
+#define GL_RGBA 0x1908
+#endif
+
+struct Image
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;     // tightly packed RGBA8
+};
+
+// runs body(begin, end) over [0, count) split into one contiguous range per hardware thread
+static void parallelFor(int count, const std::function<void(int, int)>& body)
+{
+    int threads = (int)std::thread::hardware_concurrency();
+    threads = std::max(1, std::min(threads, count));
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(body, count * t / threads, count * (t + 1) / threads);
+    body(0, count / threads);
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+// ------------------------------------------------------------------
+// mip chain
+
+// 2x2 box filter of output rows [begin, end); odd source sizes clamp to the last row/column
+static void downsampleRows(const Image& src, Image& dst, int begin, int end)
+{
+    for (int y = begin; y < end; y++)
+    {
+        int y0 = std::min(2 * y, src.height - 1);
+        int y1 = std::min(2 * y + 1, src.height - 1);
+        const unsigned char* row0 = &src.pixels[(size_t)y0 * src.width * 4];
+        const unsigned char* row1 = &src.pixels[(size_t)y1 * src.width * 4];
+        unsigned char* out = &dst.pixels[(size_t)y * dst.width * 4];
+
+        int x = 0;
+#ifdef TEXBAKE_SSE2
+        // 4 output pixels from 8 source pixels of each row per iteration
+        if (src.width % 2 == 0)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i two = _mm_set1_epi16(2);
+            for (; x + 4 <= dst.width; x += 4)
+            {
+                __m128i sums[2];
+                for (int half = 0; half < 2; half++)
+                {
+                    __m128i a = _mm_loadu_si128((const __m128i*)(row0 + (2 * x + 4 * half) * 4));
+                    __m128i b = _mm_loadu_si128((const __m128i*)(row1 + (2 * x + 4 * half) * 4));
+                    // widen to 16 bits: lo = pixels 0,1  hi = pixels 2,3
+                    __m128i aLo = _mm_unpacklo_epi8(a, zero), aHi = _mm_unpackhi_epi8(a, zero);
+                    __m128i bLo = _mm_unpacklo_epi8(b, zero), bHi = _mm_unpackhi_epi8(b, zero);
+                    __m128i vertical0 = _mm_add_epi16(aLo, bLo);
+                    __m128i vertical1 = _mm_add_epi16(aHi, bHi);
+                    // pair horizontally neighbouring pixels: (0+1, 2+3)
+                    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(vertical0, vertical1), _mm_unpackhi_epi64(vertical0, vertical1));
+                    sums[half] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+                }
+                _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(sums[0], sums[1]));
+            }
+        }
+#endif
+        for (; x < dst.width; x++)
+        {
+            int x0 = std::min(2 * x, src.width - 1);
+            int x1 = std::min(2 * x + 1, src.width - 1);
+            for (int c = 0; c < 4; c++)
+                out[x * 4 + c] = (unsigned char)((row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c] + 2) >> 2);
+        }
+    }
+}
+
+static std::vector<Image> buildMipChain(const Image& base)
+{
+    std::vector<Image> chain(1, base);
+    while (chain.back().width > 1 || chain.back().height > 1)
+    {
+        const Image& src = chain.back();
+        Image dst;
+        dst.width = std::max(1, src.width / 2);
+        dst.height = std::max(1, src.height / 2);
+        dst.pixels.resize((size_t)dst.width * dst.height * 4);
+        parallelFor(dst.height, [&](int begin, int end) { downsampleRows(src, dst, begin, end); });
+        chain.push_back(std::move(dst));
+    }
+    return chain;
+}
+
+// ------------------------------------------------------------------
+// block compression
+
+// the 16 RGBA texels of the 4x4 block at (bx, by), clamping at the image edge for levels smaller than a block
+static void fetchBlock(const Image& image, int bx, int by, float texels[16][4])
+{
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            int sx = std::min(bx * 4 + x, image.width - 1);
+            int sy = std::min(by * 4 + y, image.height - 1);
+            const unsigned char* p = &image.pixels[((size_t)sy * image.width + sx) * 4];
+            for (int c = 0; c < 4; c++)
+                texels[y * 4 + x][c] = p[c];
+        }
+    }
+}
+
+// endpoints of the block along its principal axis (power iteration on the covariance matrix)
+static void principalEndpoints(const float texels[16][4], int channels, float low[4], float high[4])
+{
+    float mean[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < channels; c++)
+            mean[c] += texels[i][c] / 16.0f;
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++)
+        for (int a = 0; a < channels; a++)
+            for (int b = 0; b < channels; b++)
+                covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+
+    float axis[4] = { 1, 1, 1, 1 };
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = { 0, 0, 0, 0 };
+        float length = 0.0f;
+        for (int a = 0; a < channels; a++)
+        {
+            for (int b = 0; b < channels; b++)
+                next[a] += covariance[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+        if (length < 1e-8f)
+            break;
+        length = sqrtf(length);
+        for (int a = 0; a < channels; a++)
+            axis[a] = next[a] / length;
+    }
+
+    float minT = 0.0f, maxT = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++)
+            t += (texels[i][c] - mean[c]) * axis[c];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    // pull the endpoints in slightly, the extremes are rarely worth an endpoint of their own
+    float inset = (maxT - minT) / 32.0f;
+    for (int c = 0; c < 4; c++)
+    {
+        float direction = c < channels ? axis[c] : 0.0f;
+        low[c] = std::min(255.0f, std::max(0.0f, mean[c] + (minT + inset) * direction));
+        high[c] = std::min(255.0f, std::max(0.0f, mean[c] + (maxT - inset) * direction));
+    }
+}
+
+static float distanceSquared(const float a[4], const float b[4], int channels)
+{
+    float sum = 0.0f;
+    for (int c = 0; c < channels; c++)
+        sum += (a[c] - b[c]) * (a[c] - b[c]);
+    return sum;
+}
+
+static uint16_t packRGB565(const float color[3])
+{
+    int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+    int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+    int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t packed, float color[4])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (float)((r << 3) | (r >> 2));
+    color[1] = (float)((g << 2) | (g >> 4));
+    color[2] = (float)((b << 3) | (b >> 2));
+    color[3] = 255.0f;
+}
+
+// BC1 (DXT1), opaque four-color mode
+static void encodeBC1(const float texels[16][4], unsigned char* block)
+{
+    float low[4], high[4];
+    principalEndpoints(texels, 3, low, high);
+    uint16_t color0 = packRGB565(high);
+    uint16_t color1 = packRGB565(low);
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    float palette[4][4];
+    unpackRGB565(color0, palette[0]);
+    unpackRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1)      // equal endpoints would select the three-color mode; index 0 is right for every texel then
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            float bestError = distanceSquared(texels[i], palette[0], 3);
+            for (int p = 1; p < 4; p++)
+            {
+                float error = distanceSquared(texels[i], palette[p], 3);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    block[0] = (unsigned char)(color0 & 0xff);
+    block[1] = (unsigned char)(color0 >> 8);
+    block[2] = (unsigned char)(color1 & 0xff);
+    block[3] = (unsigned char)(color1 >> 8);
+    for (int i = 0; i < 4; i++)
+        block[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+// appends bits to a 128-bit block, least significant bit first
+struct BitWriter
+{
+    unsigned char* bytes;
+    int position;
+
+    void write(uint32_t value, int count)
+    {
+        for (int i = 0; i < count; i++, position++)
+            if (value & (1u << i))
+                bytes[position >> 3] |= (unsigned char)(1u << (position & 7));
+    }
+};
+
+// BC7 mode 6: one subset, RGBA 7.7.7.7 endpoints with a p-bit each, 4-bit indices
+static void encodeBC7(const float texels[16][4], unsigned char* block)
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    float ends[2][4];
+    principalEndpoints(texels, 4, ends[0], ends[1]);
+
+    // quantize each endpoint to 7 bits per channel plus the shared p-bit that fits it best
+    int quantized[2][4];
+    int pbits[2];
+    float expanded[2][4];
+    for (int e = 0; e < 2; e++)
+    {
+        float bestError = 1e30f;
+        for (int p = 0; p < 2; p++)
+        {
+            int q[4];
+            float value[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++)
+            {
+                q[c] = std::min(127, std::max(0, (int)((ends[e][c] - p) / 2.0f + 0.5f)));
+                value[c] = (float)((q[c] << 1) | p);
+                error += (value[c] - ends[e][c]) * (value[c] - ends[e][c]);
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbits[e] = p;
+                memcpy(quantized[e], q, sizeof q);
+                memcpy(expanded[e], value, sizeof value);
+            }
+        }
+    }
+
+    float palette[16][4];
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 4; c++)
+            palette[i][c] = (float)((((64 - weights[i]) * (int)expanded[0][c] + weights[i] * (int)expanded[1][c] + 32) >> 6));
+
+    int indices[16];
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0;
+        float bestError = distanceSquared(texels[i], palette[0], 4);
+        for (int p = 1; p < 16; p++)
+        {
+            float error = distanceSquared(texels[i], palette[p], 4);
+            if (error < bestError)
+            {
+                bestError = error;
+                best = p;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // the anchor (first) index is stored with its top bit implied zero
+    if (indices[0] & 8)
+    {
+        std::swap(quantized[0], quantized[1]);
+        std::swap(pbits[0], pbits[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(block, 0, 16);
+    BitWriter bits = { block, 0 };
+    bits.write(1u << 6, 7);     // mode 6
+    for (int c = 0; c < 4; c++)
+    {
+        bits.write((uint32_t)quantized[0][c], 7);
+        bits.write((uint32_t)quantized[1][c], 7);
+    }
+    bits.write((uint32_t)pbits[0], 1);
+    bits.write((uint32_t)pbits[1], 1);
+    bits.write((uint32_t)indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        bits.write((uint32_t)indices[i], 4);
+}
+
+static std::vector<unsigned char> compressLevel(const Image& image, uint32_t internalFormat)
+{
+    int blocksX = (image.width + 3) / 4;
+    int blocksY = (image.height + 3) / 4;
+    uint32_t blockBytes = ktxBlockBytes(internalFormat);
+    std::vector<unsigned char> data((size_t)blocksX * blocksY * blockBytes);
+    parallelFor(blocksY, [&](int begin, int end) {
+        float texels[16][4];
+        for (int by = begin; by < end; by++)
+        {
+            for (int bx = 0; bx < blocksX; bx++)
+            {
+                fetchBlock(image, bx, by, texels);
+                unsigned char* block = &data[((size_t)by * blocksX + bx) * blockBytes];
+                if (internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM)
+                    encodeBC7(texels, block);
+                else
+                    encodeBC1(texels, block);
+            }
+        }
+    });
+    return data;
+}
+
+// ------------------------------------------------------------------
+
+static void writeUint32(std::ofstream& out, uint32_t value)
+{
+    out.write((const char*)&value, sizeof value);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    int size = 1024;
+    const char* input = NULL;
+    const char* output = NULL;
+    bool valid = true;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc)
+        {
+            std::string format = argv[++i];
+            if (format == "bc7")
+                internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+            else if (format != "bc1")
+                valid = false;
+        }
+        else if (arg == "--size" && i + 1 < argc)
+            size = atoi(argv[++i]);
+        else if (input == NULL)
+            input = argv[i];
+        else
+            output = argv[i];
+    }
+    if (!valid || input == NULL || output == NULL || size <= 0)
+    {
+        std::cerr << "Usage: texbake [--format bc1|bc7] [--size 1024] input.jpg output.ktx" << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // GL expects the bottom row first, like the runtime's stbi_set_flip_vertically_on_load(true)
+    stbi_set_flip_vertically_on_load(true);
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(input, &width, &height, &channels, 4);
+    if (pixels == NULL)
+    {
+        std::cerr << "texbake: cannot load " << input << std::endl;
+        return 1;
+    }
+    Image base;
+    base.width = size;
+    base.height = size;
+    base.pixels = resizeImage(pixels, width, height, 4, size, size);
+    stbi_image_free(pixels);
+
+    std::vector<Image> chain = buildMipChain(base);
+    std::vector<std::vector<unsigned char> > levels;
+    for (const Image& level : chain)
+        levels.push_back(compressLevel(level, internalFormat));
+
+    // KTXorientation tells other tools that the rows are stored bottom-up
+    static const char orientation[] = "KTXorientation\0S=r,T=u";
+    uint32_t keyValueSize = sizeof orientation;
+    uint32_t keyValuePadded = (4 + keyValueSize + 3) & ~3u;
+
+    KtxHeader header;
+    memcpy(header.identifier, KTX_IDENTIFIER, sizeof KTX_IDENTIFIER);
+    header.endianness = KTX_ENDIANNESS;
+    header.glType = 0;
+    header.glTypeSize = 1;
+    header.glFormat = 0;
+    header.glInternalFormat = internalFormat;
+    header.glBaseInternalFormat = internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM ? GL_RGBA : GL_RGB;
+    header.pixelWidth = (uint32_t)size;
+    header.pixelHeight = (uint32_t)size;
+    header.pixelDepth = 0;
+    header.numberOfArrayElements = 0;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = (uint32_t)levels.size();
+    header.bytesOfKeyValueData = keyValuePadded;
+
+    std::ofstream out(output, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "texbake: cannot write " << output << std::endl;
+        return 1;
+    }
+    static const char padding[4] = { 0, 0, 0, 0 };
+    out.write((const char*)&header, sizeof header);
+    writeUint32(out, keyValueSize);
+    out.write(orientation, keyValueSize);
+    out.write(padding, keyValuePadded - 4 - keyValueSize);
+    size_t bytes = sizeof header + keyValuePadded;
+    for (const std::vector<unsigned char>& level : levels)
+    {
+        writeUint32(out, (uint32_t)level.size());
+        out.write((const char*)level.data(), level.size());
+        out.write(padding, (4 - level.size() % 4) % 4);
+        bytes += 4 + ((level.size() + 3) & ~(size_t)3);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << output << ": " << size << "x" << size << ", " << levels.size() << " levels, "
+              << (internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM ? "BC7" : "BC1") << ", " << bytes << " bytes ("
+              << (size_t)size * size * 4 * 4 / 3 << " as RGBA8 with mips), baked in " << ms << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Microbenchmark: chained glm::translate/rotate/scale plus transpose(inverse()) for the normal
+// matrix, against TransformStore's batch SIMD kernels, at 1k/10k/100k objects.
+//
+// Build (from the repository root, LOGL headers on the include path):
+//   g++ -O2 -std=c++11 -msse2 [-mavx] -I. tools/transform_bench.cpp -o transform_bench
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "transform_store.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedNs(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::nano>(to - from).count();
+}
+
+static float randomRange(float lo, float hi)
+{
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+int main()
+{
+    const int counts[] = { 1000, 10000, 100000 };
+    const int repeats = 20;
+
+#if defined(TRANSFORM_STORE_AVX)
+    const char* kernel = "AVX";
+#elif defined(TRANSFORM_STORE_SSE)
+    const char* kernel = "SSE";
+#else
+    const char* kernel = "scalar";
+#endif
+    printf("kernel: %s\n", kernel);
+    printf("%8s %14s %14s %9s %12s\n", "objects", "glm ns/obj", "soa ns/obj", "speedup", "max error");
+
+    for (int count : counts)
+    {
+        std::vector<glm::vec3> positions(count), axes(count), scales(count);
+        std::vector<float> angles(count);
+        TransformStore store;
+        for (int i = 0; i < count; i++)
+        {
+            positions[i] = glm::vec3(randomRange(-50.0f, 50.0f), randomRange(-50.0f, 50.0f), randomRange(-50.0f, 50.0f));
+            axes[i] = glm::vec3(randomRange(-1.0f, 1.0f), randomRange(-1.0f, 1.0f), randomRange(0.1f, 1.0f));
+            angles[i] = randomRange(0.0f, 6.28f);
+            scales[i] = glm::vec3(randomRange(0.1f, 4.0f), randomRange(0.1f, 4.0f), randomRange(0.1f, 4.0f));
+            store.add(positions[i], scales[i]);
+            store.setRotation(i, angles[i], axes[i]);
+        }
+
+        std::vector<glm::mat4> glmMatrices(count), soaMatrices(count);
+        std::vector<glm::mat3> glmNormals(count), soaNormals(count);
+
+        // the current per-object path: chained glm calls and a general inverse for the normal matrix
+        double glmBest = 1e30;
+        for (int r = 0; r < repeats; r++)
+        {
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < count; i++)
+            {
+                glm::mat4 model = glm::mat4(1.0f);
+                model = glm::translate(model, positions[i]);
+                model = glm::rotate(model, angles[i], axes[i]);
+                model = glm::scale(model, scales[i]);
+                glmMatrices[i] = model;
+                glmNormals[i] = glm::mat3(glm::transpose(glm::inverse(model)));
+            }
+            double ns = elapsedNs(start, Clock::now());
+            if (ns < glmBest)
+                glmBest = ns;
+        }
+
+        double soaBest = 1e30;
+        for (int r = 0; r < repeats; r++)
+        {
+            Clock::time_point start = Clock::now();
+            store.composeAll(soaMatrices.data(), soaNormals.data());
+            double ns = elapsedNs(start, Clock::now());
+            if (ns < soaBest)
+                soaBest = ns;
+        }
+
+        // relative error against the glm results
+        float maxError = 0.0f;
+        for (int i = 0; i < count; i++)
+        {
+            for (int c = 0; c < 4; c++)
+                for (int row = 0; row < 4; row++)
+                {
+                    float reference = glmMatrices[i][c][row];
+                    float e = std::fabs(reference - soaMatrices[i][c][row]) / (1.0f + std::fabs(reference));
+                    if (e > maxError)
+                        maxError = e;
+                }
+            for (int c = 0; c < 3; c++)
+                for (int row = 0; row < 3; row++)
+                {
+                    float reference = glmNormals[i][c][row];
+                    float e = std::fabs(reference - soaNormals[i][c][row]) / (1.0f + std::fabs(reference));
+                    if (e > maxError)
+                        maxError = e;
+                }
+        }
+
+        printf("%8d %14.2f %14.2f %8.2fx %12.2e\n", count, glmBest / count, soaBest / count, glmBest / soaBest, maxError);
+    }
+    return 0;
+}
@@ -0,0 +1,293 @@
+#ifndef TRANSFORM_STORE_H
+#define TRANSFORM_STORE_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_STORE_SSE 1
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+#if defined(__AVX__)
+#define TRANSFORM_STORE_AVX 1
+#include <immintrin.h>
+#endif
+
+// Translation/rotation/scale of many objects in structure-of-arrays form. The batch kernels turn
+// them into model matrices and normal matrices (the inverse transpose of the upper 3x3, so the
+// vertex shader does not have to invert per vertex) four (SSE) or eight (AVX) objects at a time.
+// Rotations are stored as unit quaternions; a rotation matrix R with scale S gives the normal
+// matrix (R S)^-T = R S^-1, which needs no general inverse.
+class TransformStore
+{
+public:
+    std::vector<float> PosX, PosY, PosZ;
+    std::vector<float> RotX, RotY, RotZ, RotW;
+    std::vector<float> ScaleX, ScaleY, ScaleZ;
+
+    size_t size() const
+    {
+        return PosX.size();
+    }
+
+    int add(const glm::vec3& position, const glm::vec3& scale)
+    {
+        int id = (int)PosX.size();
+        PosX.push_back(position.x);
+        PosY.push_back(position.y);
+        PosZ.push_back(position.z);
+        RotX.push_back(0.0f);
+        RotY.push_back(0.0f);
+        RotZ.push_back(0.0f);
+        RotW.push_back(1.0f);
+        ScaleX.push_back(scale.x);
+        ScaleY.push_back(scale.y);
+        ScaleZ.push_back(scale.z);
+        return id;
+    }
+
+    void setPosition(int id, const glm::vec3& position)
+    {
+        PosX[id] = position.x;
+        PosY[id] = position.y;
+        PosZ[id] = position.z;
+    }
+
+    // same convention as glm::rotate: angle in radians around an axis that does not need to be normalized
+    void setRotation(int id, float angle, const glm::vec3& axis)
+    {
+        float length = std::sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+        float s = length > 0.0f ? std::sin(angle * 0.5f) / length : 0.0f;
+        RotX[id] = axis.x * s;
+        RotY[id] = axis.y * s;
+        RotZ[id] = axis.z * s;
+        RotW[id] = length > 0.0f ? std::cos(angle * 0.5f) : 1.0f;
+    }
+
+    void setScale(int id, const glm::vec3& scale)
+    {
+        ScaleX[id] = scale.x;
+        ScaleY[id] = scale.y;
+        ScaleZ[id] = scale.z;
+    }
+
+    // composes every transform; matrices[i] and normals[i] receive object i
+    void composeAll(glm::mat4* matrices, glm::mat3* normals) const
+    {
+        size_t count = size();
+        size_t i = 0;
+#if defined(TRANSFORM_STORE_SSE)
+        const std::vector<float>* arrays[10] = { &PosX, &PosY, &PosZ, &RotX, &RotY, &RotZ, &RotW, &ScaleX, &ScaleY, &ScaleZ };
+#endif
+#if defined(TRANSFORM_STORE_AVX)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 in[10];
+            for (int a = 0; a < 10; a++)
+                in[a] = _mm256_loadu_ps(arrays[a]->data() + i);
+            composeLanes8(in, matrices + i, normals + i);
+        }
+#endif
+#if defined(TRANSFORM_STORE_SSE)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 in[10];
+            for (int a = 0; a < 10; a++)
+                in[a] = _mm_loadu_ps(arrays[a]->data() + i);
+            glm::mat4* m[4] = { matrices + i, matrices + i + 1, matrices + i + 2, matrices + i + 3 };
+            glm::mat3* n[4] = { normals + i, normals + i + 1, normals + i + 2, normals + i + 3 };
+            composeLanes4(in, m, n);
+        }
+#endif
+        for (; i < count; i++)
+            composeScalar((int)i, matrices[i], normals[i]);
+    }
+
+    // composes only the listed transforms; matrices[id] and normals[id] receive object id
+    void compose(const int* ids, size_t count, glm::mat4* matrices, glm::mat3* normals) const
+    {
+        size_t i = 0;
+#if defined(TRANSFORM_STORE_SSE)
+        const std::vector<float>* arrays[10] = { &PosX, &PosY, &PosZ, &RotX, &RotY, &RotZ, &RotW, &ScaleX, &ScaleY, &ScaleZ };
+        for (; i + 4 <= count; i += 4)
+        {
+            const int* id = ids + i;
+            __m128 in[10];
+            for (int a = 0; a < 10; a++)
+            {
+                const float* v = arrays[a]->data();
+                in[a] = _mm_set_ps(v[id[3]], v[id[2]], v[id[1]], v[id[0]]);
+            }
+            glm::mat4* m[4] = { matrices + id[0], matrices + id[1], matrices + id[2], matrices + id[3] };
+            glm::mat3* n[4] = { normals + id[0], normals + id[1], normals + id[2], normals + id[3] };
+            composeLanes4(in, m, n);
+        }
+#endif
+        for (; i < count; i++)
+            composeScalar(ids[i], matrices[ids[i]], normals[ids[i]]);
+    }
+
+    // reference implementation, also used for the tail of a batch
+    void composeScalar(int i, glm::mat4& matrix, glm::mat3& normal) const
+    {
+        float x = RotX[i], y = RotY[i], z = RotZ[i], w = RotW[i];
+        float r00 = 1.0f - 2.0f * (y * y + z * z), r01 = 2.0f * (x * y - w * z), r02 = 2.0f * (x * z + w * y);
+        float r10 = 2.0f * (x * y + w * z), r11 = 1.0f - 2.0f * (x * x + z * z), r12 = 2.0f * (y * z - w * x);
+        float r20 = 2.0f * (x * z - w * y), r21 = 2.0f * (y * z + w * x), r22 = 1.0f - 2.0f * (x * x + y * y);
+        float sx = ScaleX[i], sy = ScaleY[i], sz = ScaleZ[i];
+
+        matrix[0] = glm::vec4(r00 * sx, r10 * sx, r20 * sx, 0.0f);
+        matrix[1] = glm::vec4(r01 * sy, r11 * sy, r21 * sy, 0.0f);
+        matrix[2] = glm::vec4(r02 * sz, r12 * sz, r22 * sz, 0.0f);
+        matrix[3] = glm::vec4(PosX[i], PosY[i], PosZ[i], 1.0f);
+
+        normal[0] = glm::vec3(r00 / sx, r10 / sx, r20 / sx);
+        normal[1] = glm::vec3(r01 / sy, r11 / sy, r21 / sy);
+        normal[2] = glm::vec3(r02 / sz, r12 / sz, r22 / sz);
+    }
+
+private:
+#if defined(TRANSFORM_STORE_SSE)
+    // in: px py pz qx qy qz qw sx sy sz, one object per lane
+    static void composeLanes4(const __m128* in, glm::mat4** matrices, glm::mat3** normals)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 two = _mm_set1_ps(2.0f);
+        __m128 x = in[3], y = in[4], z = in[5], w = in[6];
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        // rotation matrix, rRC = row R, column C
+        __m128 r[3][3];
+        r[0][0] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+        r[0][1] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+        r[0][2] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+        r[1][0] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+        r[1][1] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+        r[1][2] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+        r[2][0] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+        r[2][1] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+        r[2][2] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+        const __m128 zero = _mm_setzero_ps();
+        __m128 columns[4][4];   // [column][row], lanes = objects
+        __m128 normalColumns[3][3];
+        for (int c = 0; c < 3; c++)
+        {
+            __m128 s = in[7 + c];
+            __m128 invS = _mm_div_ps(one, s);
+            for (int row = 0; row < 3; row++)
+            {
+                columns[c][row] = _mm_mul_ps(r[row][c], s);
+                normalColumns[c][row] = _mm_mul_ps(r[row][c], invS);
+            }
+            columns[c][3] = zero;
+        }
+        columns[3][0] = in[0];
+        columns[3][1] = in[1];
+        columns[3][2] = in[2];
+        columns[3][3] = one;
+
+        // transpose lanes into per-object columns
+        for (int c = 0; c < 4; c++)
+        {
+            __m128 a = columns[c][0], b = columns[c][1], d = columns[c][2], e = columns[c][3];
+            _MM_TRANSPOSE4_PS(a, b, d, e);
+            _mm_storeu_ps(&(*matrices[0])[c][0], a);
+            _mm_storeu_ps(&(*matrices[1])[c][0], b);
+            _mm_storeu_ps(&(*matrices[2])[c][0], d);
+            _mm_storeu_ps(&(*matrices[3])[c][0], e);
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            __m128 a = normalColumns[c][0], b = normalColumns[c][1], d = normalColumns[c][2], e = zero;
+            _MM_TRANSPOSE4_PS(a, b, d, e);
+            __m128 lanes[4] = { a, b, d, e };
+            for (int o = 0; o < 4; o++)
+            {
+                // a mat3 column is three floats; store two, then one, to stay inside the object
+                float* dst = &(*normals[o])[c][0];
+                _mm_storel_pi((__m64*)dst, lanes[o]);
+                _mm_store_ss(dst + 2, _mm_movehl_ps(lanes[o], lanes[o]));
+            }
+        }
+    }
+#endif
+
+#if defined(TRANSFORM_STORE_AVX)
+    // eight objects per call; the rotation/scale math runs 8-wide, the AoS write-out reuses the 4-wide transpose
+    static void composeLanes8(const __m256* in, glm::mat4* matrices, glm::mat3* normals)
+    {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 two = _mm256_set1_ps(2.0f);
+        __m256 x = in[3], y = in[4], z = in[5], w = in[6];
+        __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+        __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+        __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+        __m256 r[3][3];
+        r[0][0] = _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz)));
+        r[0][1] = _mm256_mul_ps(two, _mm256_sub_ps(xy, wz));
+        r[0][2] = _mm256_mul_ps(two, _mm256_add_ps(xz, wy));
+        r[1][0] = _mm256_mul_ps(two, _mm256_add_ps(xy, wz));
+        r[1][1] = _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz)));
+        r[1][2] = _mm256_mul_ps(two, _mm256_sub_ps(yz, wx));
+        r[2][0] = _mm256_mul_ps(two, _mm256_sub_ps(xz, wy));
+        r[2][1] = _mm256_mul_ps(two, _mm256_add_ps(yz, wx));
+        r[2][2] = _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy)));
+
+        const __m128 zero = _mm_setzero_ps();
+        for (int half = 0; half < 2; half++)
+        {
+            glm::mat4* m = matrices + half * 4;
+            glm::mat3* n = normals + half * 4;
+            for (int c = 0; c < 4; c++)
+            {
+                __m128 rows[4];
+                if (c < 3)
+                {
+                    __m256 s = in[7 + c];
+                    for (int row = 0; row < 3; row++)
+                        rows[row] = lower(_mm256_mul_ps(r[row][c], s), half);
+                    rows[3] = zero;
+                }
+                else
+                {
+                    for (int row = 0; row < 3; row++)
+                        rows[row] = lower(in[row], half);
+                    rows[3] = _mm_set1_ps(1.0f);
+                }
+                _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+                for (int o = 0; o < 4; o++)
+                    _mm_storeu_ps(&m[o][c][0], rows[o]);
+            }
+            for (int c = 0; c < 3; c++)
+            {
+                __m256 invS = _mm256_div_ps(one, in[7 + c]);
+                __m128 rows[4];
+                for (int row = 0; row < 3; row++)
+                    rows[row] = lower(_mm256_mul_ps(r[row][c], invS), half);
+                rows[3] = zero;
+                _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+                for (int o = 0; o < 4; o++)
+                {
+                    float* dst = &n[o][c][0];
+                    _mm_storel_pi((__m64*)dst, rows[o]);
+                    _mm_store_ss(dst + 2, _mm_movehl_ps(rows[o], rows[o]));
+                }
+            }
+        }
+    }
+
+    static __m128 lower(__m256 v, int half)
+    {
+        return half == 0 ? _mm256_castps256_ps128(v) : _mm256_extractf128_ps(v, 1);
+    }
+#endif
+};
+#endif
@@ -0,0 +1,42 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// A uniform buffer object attached to a fixed binding point. Programs connect their uniform
+// block to the same binding point (Shader::bindUniformBlock), so data written here once is
+// seen by all of them. The C++ struct mirrored into it must follow std140 layout rules.
+class UniformBuffer
+{
+public:
+    unsigned int UBO = 0;
+    unsigned int BindingPoint = 0;
+    size_t Size = 0;
+
+    void create(size_t size, unsigned int bindingPoint)
+    {
+        Size = size;
+        BindingPoint = bindingPoint;
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, UBO);
+    }
+
+    // replaces the whole buffer; orphaning the old storage avoids waiting for draws still reading it
+    void update(const void* data)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, Size, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, Size, data);
+    }
+
+    void destroy()
+    {
+        glDeleteBuffers(1, &UBO);
+        UBO = 0;
+    }
+};
+#endif